@@ -14,6 +14,7 @@
 
 #ifndef BASE_INCLUDED
 #define BASE_INCLUDED
+typedef unsigned long long U64;
 typedef unsigned int U32;
 typedef signed int S32;
 typedef unsigned char U8;
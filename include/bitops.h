@@ -0,0 +1,21 @@
+/* Bit operations on 32-bit words. The kernel is linked without libgcc, so
+   count-trailing-zeros is done with a de Bruijn multiplication instead of
+   __builtin_ctz */
+#ifndef _BITOPS_H
+#define _BITOPS_H
+#include <base.h>
+
+#define DEBRUIJN_32 0x077CB531U
+
+/* Index of the least significant bit set in x (x must not be 0) */
+static inline int ctz32(U32 x)
+{
+	static const U8 pos[32] = {
+		0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+		31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
+	};
+
+	return pos[((x & -x) * DEBRUIJN_32) >> 27];
+}
+
+#endif
@@ -12,6 +12,19 @@
 /* Maxi number of overall (eg, system, daemons, user) concurrent processes */
 #define MAXPROC 20
 
+/* Number of CPUs the kernel is built for (uMPS2 can emulate up to 16).
+   With NCPU == 1 the kernel behaves as the uniprocessor one */
+#ifndef NCPU
+#define NCPU 1
+#endif
+
+/* Id of the CPU executing the code (getPRID() exists only on uMPS2) */
+#if NCPU > 1
+#define CPU_ID ((int) getPRID())
+#else
+#define CPU_ID 0
+#endif
+
 #define UPROCMAX 3  /* number of usermode processes (not including master proc
 											 and system daemons */
 
@@ -47,19 +60,45 @@
 
 #define SYSCALL_MAX 12
 
+/* GETCPUTIME selectors (passed in a1) */
+#define CPUT_TOTAL 0  /* user + kernel time on behalf of the process */
+#define CPUT_USER 1
+#define CPUT_SYS 2
+#define CPUT_WAIT 3   /* time spent waiting in the Ready Queue */
+#define CPUT_SLICE 4  /* time used in the current time slice */
+
 /* VM/IO support level (phase3)-handled SYSCALL values */
-#define READTERMINAL 13
-#define WRITETERMINAL 14
+#define READTERMINAL 13   /* in kernel mode handled by the nucleus (terminal line discipline) */
+#define WRITETERMINAL 14  /* in kernel mode handled by the nucleus (terminal TX ring) */
 #define VSEMVIRT 15
 #define PSEMVIRT 16
-#define DELAY 17
-#define DISK_PUT 18
+#define DELAY 17          /* in kernel mode handled by the nucleus (timer wheel) */
+#define DISK_PUT 18       /* in kernel mode handled by the nucleus (block cache, disk queue) */
 #define DISK_GET 19
 #define WRITEPRINTER 20
 #define TERMINATE 21
 
 #define SYSCALL_TOT 21
 
+/* nucleus (phase2)-handled extended SYSCALL values (kernel mode only) */
+#define SETQUANTUM 22
+#define GETSCHEDSTATS 23
+#define SETQUOTA 24
+#define SETPRIORITY 25
+#define MUTEXINIT 26
+#define SETAFFINITY 27
+#define SETSLACK 28
+#define GETLATENCY 29
+#define GETDISKSTATS 30
+#define GETSYSSTATS 31
+
+#define EXT_SYSCALL_FIRST SETQUANTUM
+#define EXT_SYSCALL_LAST GETSYSSTATS
+
+/* TRUE if the SYSCALL is a nucleus one (reserved instruction in user mode) */
+#define IS_NUCLEUS_SYSCALL(n) ((((n) > 0) && ((n) < RANGE_SYSCALL)) || \
+				(((n) >= EXT_SYSCALL_FIRST) && ((n) <= EXT_SYSCALL_LAST)))
+
 /* Bus register area. Among other informations, the start and amount of
    installed RAM are stored here */
 #define BUS_RAMBASEADDR 0x10000000
@@ -75,6 +114,54 @@
 #define BUS_TODLOW 0x1000001c
 #define BUS_TODHIGH 0x10000018
 
+/* uMPS2 machine control registers: number of installed CPUs */
+#define MCTL_NCPUS 0x10000500
+
+/* uMPS2 CPU interface: inter-processor interrupts (line 0). A message written to
+   the Outbox is delivered to the Inbox of every CPU in the recipient bitmap;
+   writing the Inbox acknowledges the oldest message */
+#define CPUCTL_INBOX 0x10000400
+#define CPUCTL_OUTBOX 0x10000404
+#define CPUCTL_TPR 0x10000408
+#define IPI_RECIPIENTS_SHIFT 8
+#define IPI_RESCHEDULE 1
+
+/* uMPS2 Interrupt Routing Table: one entry for each device of lines 2-7.
+   A static entry holds the id of the target CPU; a dynamic one (IRT_RP_DYNAMIC)
+   holds a bitmap of CPUs and the interrupt goes to the one with the lowest
+   Task Priority Register */
+#define IRT_BASE 0x10000300
+#define IRT_ENTRY(line, dev) (IRT_BASE + (((((line) - INT_TIMER) * DEV_PER_INT) + (dev)) * WORD_SIZE))
+#define IRT_RP_DYNAMIC 0x10000000
+#define TPR_MAX 15
+
+/* CPU affinity masks: bit i set means the process may run on CPU i */
+#define CPU_MASK(i) (1U << (i))
+#define AFFINITY_ALL 0xFFFFFFFF
+
+/* Exception state areas handed to INITCPU for CPUs other than 0: same
+   layout as the ROM reserved frame used by CPU 0 (old/new pairs) */
+#define CPU_STATE_AREAS 8
+#define AREA_INT_OLD 0
+#define AREA_INT_NEW 1
+#define AREA_TLB_OLD 2
+#define AREA_TLB_NEW 3
+#define AREA_PGMTRAP_OLD 4
+#define AREA_PGMTRAP_NEW 5
+#define AREA_SYSBK_OLD 6
+#define AREA_SYSBK_NEW 7
+
+/* Kernel stack of each CPU other than 0 (CPU 0 uses RAMTOP) */
+#define KSTACK_SIZE FRAME_SIZE
+
+/* Nested interrupts: while a line is serviced only the lines with a higher
+   priority are unmasked, so each line nests at most once on the outermost
+   level (which unmasks them all while running the bottom halves). Every
+   nested level has its own saved state and stack (the top halves only need a
+   small one), plus a spare stack for the level above the last */
+#define INT_NEST_MAX (INT_LINES + 1)
+#define INT_STACK_SIZE (FRAME_SIZE / 4)
+
 #define DEV_USED_INTS 5 /* Number of ints reserved for devices: 3,4,5,6,7 */
 
 #define DEV_PER_INT 8 /* Maximum number of devices per interrupt line */
@@ -87,6 +174,8 @@
 #define CLOCK_SEM (MAX_DEVICES - 1)
 
 /* Interrupt lines used by the devices */
+#define INT_IPI 0          /* uMPS2 inter-processor interrupts */
+#define INT_LOCAL_TIMER 1  /* uMPS2 per-CPU timer (used for the quantum when NCPU > 1) */
 #define INT_TIMER 2    /* timer interrupt */
 #define INT_LOWEST 3   /* minimum interrupt number used by real devices */
 #define INT_DISK 3
@@ -94,6 +183,7 @@
 #define INT_UNUSED 5   /* network? */
 #define INT_PRINTER 6
 #define INT_TERMINAL 7
+#define INT_LINES 8
 
 /* Device command and status codes
    Only those actually used in the code are defined here. If the need arises,
@@ -112,7 +202,9 @@
 #define DEV_TRCV_C_RECVCHAR 2   /* terminal */
 #define DEV_TTRS_C_TRSMCHAR 2   
 
-#define DEV_S_READY   1   /* status common to all devices */
+#define DEV_S_NOTINSTALLED 0   /* status common to all devices */
+#define DEV_S_READY   1
+#define DEV_S_BUSY    3
 
 #define DEV_TRCV_S_RECVERR  4  /* terminal-specific */
 #define DEV_TRCV_S_CHARRECV 5
@@ -120,6 +212,10 @@
 #define DEV_TTRS_S_TRSMERR  4
 #define DEV_TTRS_S_CHARTRSM 5
 
+/* A terminal sub-device has completed a command (successfully or not) and
+   is waiting for the ACK when it is neither ready nor busy */
+#define TERM_DONE(status) ((((status) & CHECK_STATUS_BIT) != DEV_S_READY) && (((status) & CHECK_STATUS_BIT) != DEV_S_BUSY))
+
 #define TAPE_EOF 1
 #define TAPE_EOT 0
 
@@ -143,9 +239,11 @@
 /* Interrupting devices bitmaps starting address: the actual bitmap address is
    computed with INT_INTBITMAP_START + (WORD_SIZE * (int_no - 3)) */
 #define PENDING_BITMAP_START 0x1000003c
+#define PENDING_BITMAP(int_no) ((U32 *) (PENDING_BITMAP_START + (WORD_SIZE * ((int_no) - INT_LOWEST))))
 
 /* Installed devices bitmap starting address: same as above */
-/* #define INST_BITMAP_START 0x10000028 */
+#define INST_BITMAP_START 0x10000028
+#define INST_BITMAP(int_no) ((U32 *) (INST_BITMAP_START + (WORD_SIZE * ((int_no) - INT_LOWEST))))
 
 /* Address of the first real device register */
 #define DEV_REGS_START 0x10000050
@@ -156,13 +254,176 @@
 /* Size of a device register group */
 #define DEV_REGBLOCK_SIZE (DEV_REG_SIZE * DEV_PER_INT)
 
+/* Address of the register of device dev on interrupt line int_no */
+#define DEV_REG_ADDR(int_no, dev) (DEV_REGS_START + (((int_no) - INT_LOWEST) * DEV_REGBLOCK_SIZE) + ((dev) * DEV_REG_SIZE))
+
 /* Scheduling constants */
 #define SCHED_TIME_SLICE 5000     /* in microseconds, aka 5 milliseconds */
 #define SCHED_PSEUDO_CLOCK 100000 /* pseudo-clock tick "slice" length */
 #define SCHED_BOGUS_SLICE 500000  /* just to make sure */
 
+/* Per-process quantum bounds (SCHED_TIME_SLICE is the default quantum).
+   An adaptive quantum grows by 1/2 when the process exhausts it and shrinks
+   by 1/4 when the process blocks before using half of it */
+#define SCHED_QUANTUM_MIN 1000
+#define SCHED_QUANTUM_MAX 50000
+
+/* CPU quota groups: a process subtree may use at most q_budget microseconds
+   of CPU every q_period microseconds. Periods are refilled on the
+   pseudo-clock tick, so they cannot be shorter than SCHED_PSEUDO_CLOCK */
+#define MAXQUOTAGROUPS 4
+
+/* Process priorities: the Ready Queue is ordered by effective priority
+   (higher first, FIFO among equals), and a ready process with a higher
+   effective priority preempts the running one */
+#define PRIO_MIN 0
+#define PRIO_DEFAULT 16
+#define PRIO_MAX 31
+
+/* Timer value meaning "no deadline" */
+#define TIMER_INFINITE 0xFFFFFFFF
+
+/* Device interrupt routing with NCPU > 1: if FALSE every device is routed
+   statically (round-robin at boot, then to the CPU of its last waiter), if
+   TRUE the hardware picks the least loaded CPU (TPR = ready + running) */
+#define IRT_DYNAMIC FALSE
+
+/* Kernel spinlocks, in acquisition order: a CPU may take a lock only if its
+   rank is higher than the rank of every lock it already holds. The order is
+   checked (PANIC on violation) when the kernel is built with -DLOCK_DEBUG */
+#define LOCK_RANK_KERNEL 0   /* process tree, pcbused_table, pseudo-clock, mutexes */
+#define LOCK_RANK_DEVSEM 1   /* device semaphores and status words */
+#define LOCK_RANK_QUOTA 2    /* quota groups */
+#define LOCK_RANK_READY 3    /* + cpu id: Ready Queues, in ascending CPU order */
+#define LOCK_RANK_ASL (LOCK_RANK_READY + NCPU)
+#define LOCK_RANK_PCBMAG (LOCK_RANK_ASL + 1)  /* per-CPU pcb magazines (never nested) */
+#define LOCK_RANK_PCB (LOCK_RANK_PCBMAG + 1)
+#define LOCK_RANK_DISK (LOCK_RANK_PCB + 1)  /* disk request queues: interrupts masked, also taken by top halves */
+#define LOCK_RANK_TERM (LOCK_RANK_DISK + 1)  /* terminal rings: likewise, and above DISK because a terminal
+                                                top half can nest in a disk one (line 7 is left unmasked) */
+
+/* Per-CPU magazines of free pcbs: an empty magazine is refilled, and a
+   full one drained, MAG_BATCH entries at a time from/to the global free
+   list. Semaphore descriptors have none: they are only allocated and
+   freed under aslLock, which every P and V takes for the ASL anyway */
+#define MAG_SIZE 4
+#define MAG_BATCH 2
+
+/* Priority inheritance on semaphores registered as mutexes (MUTEXINIT):
+   the boost follows at most PI_MAX_DEPTH owners along a blocking chain,
+   and the last PI_TRACE_SIZE boosts are kept in piTrace[] */
+#define MAXMUTEX 16
+#define PI_MAX_DEPTH 8
+#define PI_TRACE_SIZE 16
+
+/* Timer wheel of the DELAY (SYS17) deadlines: TW_LEVELS levels of TW_SLOTS
+   slots each; a level-0 slot lasts 2^TW_SHIFT microseconds (a power of two,
+   so that a TOD is converted with a shift) and a slot of level n spans a
+   whole turn of level n-1. Deadlines beyond TW_MAX_TICKS are re-inserted
+   when they come within range */
+#define TW_SHIFT 7
+#define TW_SLOT_BITS 6
+#define TW_SLOTS (1 << TW_SLOT_BITS)
+#define TW_SLOT_MASK (TW_SLOTS - 1)
+#define TW_LEVELS 4
+#define TW_MAX_TICKS ((1 << (TW_SLOT_BITS * TW_LEVELS)) - 1)
+#define TW_MAP_WORDS (TW_SLOTS / 32)
+
+/* Timer slack: a DELAY may expire up to p_slack microseconds late, so that
+   wakeups falling in the same window are served by one interrupt. New
+   processes inherit their parent's slack (SETSLACK changes it) */
+#define TIMER_SLACK_DEFAULT 500
+#define TIMER_SLACK_MAX 100000
+
+/* Kernel timers (ktimer.c) share the interval timer: it is never loaded
+   with more than KTIMER_MAX_WAIT microseconds */
+#define KTIMER_MAX_WAIT 1000000
+
+/* Deferred interrupt work (bottom halves), per CPU: a power of 2 larger than
+   what one interrupt entry can queue (every device, both terminal halves and
+   the two timers) */
+#define INT_WORK_MAX 64
+#define INT_WORK_MASK (INT_WORK_MAX - 1)
+
+/* Completions nobody was waiting for are queued per device (in order, a
+   power of 2 of them); when the ring is full the oldest one is dropped */
+#define DEV_RING_SIZE 4
+#define DEV_RING_MASK (DEV_RING_SIZE - 1)
+
+/* WRITETERMINAL (SYS14): per-terminal transmit ring (a power of 2), fed by the
+   transmit interrupt one character at a time. The writer copies its buffer
+   into the ring only in its own SYSCALL: what does not fit is copied when the
+   call is restarted, once no more than TERM_TX_LOW characters are left to send */
+#define TERM_TX_SIZE 128
+#define TERM_TX_MASK (TERM_TX_SIZE - 1)
+#define TERM_TX_LOW (TERM_TX_SIZE / 2)
+#define TERM_CHAR_SHIFT 8  /* character field of the terminal commands */
+
+/* READTERMINAL (SYS13): per-terminal receive ring (a power of 2), filled by the
+   receive interrupt with echo and erase. Readers are woken once a line is
+   complete (CR/LF), or when the ring is full */
+#define TERM_RX_SIZE 128
+#define TERM_RX_MASK (TERM_RX_SIZE - 1)
+#define TERM_ERASE 0x08  /* backspace */
+#define TERM_DEL 0x7F
+
+/* DISK_PUT/DISK_GET (SYS18/19): per-disk request queue, served in C-LOOK
+   order (ascending sector, i.e. cylinder/head/sector, then back to the
+   lowest one). Building with -DDISK_FIFO serves it in arrival order, to
+   compare the GETDISKSTATS seek counters (p2test's disk benchmark, with
+   -DP2TEST_BENCH). Only requests for the same sector are merged: READBLK and
+   WRITEBLK move a single sector, so adjacent sectors cannot share a command.
+   The block is moved between a cache block and the disk's DMA page
+   (OS_D_DMA_START): process buffers are copied only in their own SYSCALL */
+#define DISK_DMA_BUF(dev) ((OS_D_DMA_START) + ((dev) * PAGE_SIZE))
+#define DISK_MAX_CYL(data1) ((data1) >> 16)    /* geometry, in DATA1 */
+#define DISK_MAX_HEAD(data1) (((data1) >> 8) & 0xFF)
+#define DISK_MAX_SECT(data1) ((data1) & 0xFF)
+#define DISK_SEEK_CMD(cyl) (((cyl) << 8) | DEV_DISK_C_SEEKCYL)
+#define DISK_XFER_CMD(head, sect, write) (((sect) << 16) | ((head) << 8) | ((write) ? DEV_DISK_C_WRITEBLK : DEV_DISK_C_READBLK))
+#define DISK_REQS (2 * MAXPROC)  /* request descriptors per disk */
+#define DISK_IDLE 0   /* no request on the device */
+#define DISK_SEEK 1   /* seeking the cylinder of the current request */
+#define DISK_WAIT 2   /* on the cylinder, waiting for the DMA page */
+#define DISK_XFER 3   /* transferring the block */
+
+/* Block cache under DISK_PUT/DISK_GET: BCACHE_BLOCKS blocks, LRU replacement,
+   write-back. Dirty blocks are written when they reach the LRU end of the
+   list and at every pseudo-clock tick. A block whose write-back fails
+   BCACHE_WB_RETRIES times in a row is dropped (its data is lost) */
+#define BCACHE_BLOCKS 8
+#define BCACHE_WB_RETRIES 3
+
+/* Device latency histograms (GETLATENCY), kept only when the kernel is built
+   with -DLAT_HIST. Bucket 0 counts latencies of 0 microseconds, bucket b those
+   in [2^(b-1), 2^b), the last one everything above */
+#define LAT_BUCKETS 16
+#define LAT_ACK 0   /* interrupt entry -> device acknowledged */
+#define LAT_WAKE 1  /* interrupt entry -> waiter runnable */
+#define LAT_RUN 2   /* waiter runnable -> waiter dispatched */
+#define LAT_KINDS 3
+
+/* Load average, sampled by a periodic kernel timer every LOAD_PERIOD
+   microseconds: fixed point with LOAD_SHIFT fractional bits, decaying by
+   LOAD_EXP / 2^LOAD_SHIFT per sample (a 1 minute average) */
+#define LOAD_PERIOD 5000000
+#define LOAD_SHIFT 11
+#define LOAD_FIXED_1 (1 << LOAD_SHIFT)
+#define LOAD_EXP 1884
+
+/* Tickless mode: when no other process is ready, the running process' time
+   slice does not expire and the interval timer is programmed only for the
+   next real event (the pseudo-clock tick) */
+#define SCHED_TICKLESS TRUE
+
+/* Kernel clock: ticks are converted to microseconds as
+   (ticks * mult) >> CLOCK_SHIFT, with mult = 2^CLOCK_SHIFT / BUS_TIMESCALE
+   precomputed at boot, so that the hot path never divides */
+#define CLOCK_SHIFT 24
+
 /* The next two are used a lot and should better be "inlined" for speed, so
-   define them as macros */
+   define them as macros (the kernel itself uses the clock.e API, which reads
+   the whole 64-bit TOD and does not divide) */
 
 /* "current" TOD value (elapsed CPU ticks), converted in microseconds */
 #define GET_TODLOW (*((U32 *)BUS_TODLOW) / (*(U32 *)BUS_TIMESCALE))
@@ -188,6 +449,9 @@
 /* All interrupts unmasked */
 #define STATUS_INT_UNMASKED 0x0000ff00
 
+/* Interrupt mask bits for a bitmap of lines (bit n = line n) */
+#define STATUS_IM(lines) (((lines) & 0xFF) << 8)
+
 /* Utility definitions for the entryHI register */
 #define ENTRYHI_SEGNO_GET(entryHI) (((entryHI) & 0xc0000000) >> 30)
 #define ENTRYHI_VPN_GET(entryHI) (((entryHI) & 0x3ffff000) >> 12)
@@ -214,6 +478,9 @@
 /* Returns 1 if the interrupt int_no is pending */
 #define CAUSE_IP_GET(cause, int_no) ((cause) & (1 << ((int_no) + 8)))
 
+/* Bitmap of the pending interrupt lines (bit n = line n) */
+#define CAUSE_IP_BITS(cause) (((cause) >> 8) & 0xFF)
+
 /* Values for CP0 Cause.ExcCode */
 #define EXC_INTERRUPT 0
 #define EXC_TLBMOD 1
@@ -317,34 +584,15 @@
 #define IS_ON_DEV 1
 #define IS_ON_PSEUDO 2
 #define IS_ON_SEM 3
-
-/* Status Word Table */
-#define STATUS_WORD_ROWS 6
-#define STATUS_WORD_COLS 8
-
-/* Device Check Address */
-#define DEV_CHECK_ADDRESS_0 0x1
-#define DEV_CHECK_ADDRESS_1 0x2
-#define DEV_CHECK_ADDRESS_2 0x4
-#define DEV_CHECK_ADDRESS_3 0x8
-#define DEV_CHECK_ADDRESS_4 0x10
-#define DEV_CHECK_ADDRESS_5 0x20
-#define DEV_CHECK_ADDRESS_6 0x40
-#define DEV_CHECK_ADDRESS_7 0x80
-
-/* Device Check Line */
-#define DEV_CHECK_LINE_0 0
-#define DEV_CHECK_LINE_1 1
-#define DEV_CHECK_LINE_2 2
-#define DEV_CHECK_LINE_3 3
-#define DEV_CHECK_LINE_4 4
-#define DEV_CHECK_LINE_5 5
-#define DEV_CHECK_LINE_6 6
-#define DEV_CHECK_LINE_7 7
-
-/* Check Bit */
-#define CHECK_FIFTH_BIT 	0x10
-#define CHECK_EIGHTH_BIT 	0x80
+#define IS_THROTTLED 4  /* out of the Ready Queue until its quota group refills */
+#define IS_SLEEPING 5   /* DELAY: waiting for its deadline in the timer wheel */
+#define IS_ON_TERM 6    /* READ/WRITETERMINAL: queued on a terminal's readers or writers */
+#define IS_ON_DISK 7    /* DISK_PUT/DISK_GET: waiting on a disk read or a cache block */
+
+/* Device table: one row per device line, plus one for the receive half of
+   the terminals */
+#define DEV_TABLE_ROWS 6
+#define DEV_ROW(int_no, termRead) ((int_no) - DEV_DIFF + (((int_no) == INT_TERMINAL) && (termRead)))
 
 /* Device Diff */
 #define DEV_DIFF 3
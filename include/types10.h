@@ -4,6 +4,62 @@
 #include <listx.h>
 #include <const.h>
 
+/* Gruppo di quota di CPU (un sottoalbero di processi) */
+typedef struct quota_group_t {
+	/* TRUE se il gruppo è in uso */
+	int q_active;
+	
+	/* Numero di processi appartenenti al gruppo */
+	int q_members;
+	
+	/* CPU concessa per periodo, lunghezza del periodo e CPU usata nel periodo corrente */
+	cpu_t q_budget;
+	cpu_t q_period;
+	cpu_t q_used;
+	
+	/* Fine del periodo corrente */
+	tod_t q_periodEnd;
+	
+	/* TRUE se il budget è esaurito: i membri pronti attendono in q_throttledQ */
+	int q_throttled;
+	struct list_head q_throttledQ;
+	
+	/* Numero di volte in cui il gruppo è stato strozzato */
+	U32 q_throttleCount;
+} quota_group_t;
+
+/* Timer della timer wheel */
+typedef struct tw_timer_t {
+	/* Lista dello slot in cui si trova */
+	struct list_head t_next;
+	
+	/* Scadenza, in tick della ruota (2^TW_SHIFT microsecondi) */
+	U32 t_expires;
+	
+	/* TRUE se il timer è nella ruota, e slot (livello * TW_SLOTS + indice) che lo contiene */
+	int t_armed;
+	int t_slot;
+} tw_timer_t;
+
+/* Timer del nucleo (ktimer.c), multiplexato sull'Interval Timer */
+typedef struct ktimer_t {
+	/* Posizione nella timer wheel */
+	tw_timer_t k_tw;
+	
+	/* Scadenza (microsecondi) e periodo (0 se il timer non è periodico) */
+	tod_t k_when;
+	U32 k_period;
+	
+	/* Funzione chiamata alla scadenza, con kernelLock preso */
+	void (*k_func)(struct ktimer_t *k);
+	
+	/* Numero di scadenze */
+	U32 k_fired;
+	
+	/* TRUE se lo slack ha spostato il timer su un tick in cui scadevano già altri timer */
+	int k_joined;
+} ktimer_t;
+
 typedef struct pcb_t {
 	/*process queue fields */
 
@@ -23,9 +79,73 @@ typedef struct pcb_t {
 	/* process id */
 	int p_pid;
 	
-	/* CPU_TIME of process */
+	/* CPU_TIME of process (total, user + kernel on its behalf) */
 	cpu_t p_cpu_time;
 	
+	/* CPU time used in the current time slice */
+	cpu_t p_slice_time;
+	
+	/* CPU time spent in the kernel on behalf of the process */
+	cpu_t p_sys_time;
+	
+	/* Time spent waiting in the Ready Queue */
+	cpu_t p_wait_time;
+	
+	/* TOD of the last insertion in the Ready Queue */
+	tod_t p_readyTOD;
+	
+	/* Time quantum and adaptive flag */
+	cpu_t p_quantum;
+	int p_adaptive;
+	
+	/* CPU whose Ready Queue holds the process (or that last ran it) */
+	int p_cpu;
+	
+	/* DELAY deadline and allowed lateness (timer slack, microseconds) */
+	ktimer_t p_sleep;
+	U32 p_slack;
+	
+	/* CPUs the process may run on (CPU_MASK bits) */
+	U32 p_affinity;
+	
+#ifdef LAT_HIST
+	/* Device whose completion made the process runnable, and when (GETLATENCY) */
+	struct device_t *p_latDev;
+	tod_t p_latWake;
+#endif
+	
+	/* Terminal or disk I/O in progress: next character, characters still to
+	   copy, characters accepted so far and device (READ/WRITETERMINAL; DISK_PUT/GET
+	   only the device) */
+	char *p_ioBuf;
+	U32 p_ioLeft;
+	U32 p_ioDone;
+	int p_ioDev;
+	
+	/* WRITETERMINAL: characters still in the transmit ring, status of the failed
+	   transmission (0 if none) */
+	U32 p_ioQueued;
+	U32 p_ioError;
+	
+	/* DISK_PUT/GET restarted after a wait: the access has already been counted */
+	int p_ioRestart;
+	
+	/* Terminated while on another CPU: that CPU frees the pcb */
+	int p_killed;
+	
+	/* Base and effective (possibly inherited) priority */
+	int p_prio;
+	int p_effprio;
+	
+	/* CPU quota group (NULL if none) */
+	quota_group_t *p_group;
+	
+	/* Scheduler statistics */
+	U32 p_dispatches;
+	U32 p_preemptions;
+	U32 p_blocks;
+	U32 p_boosts;
+	
 	/* Exception State Vector */
 	int ExStVec[MAX_STATE_VECTOR];
 	
@@ -52,6 +172,340 @@ typedef struct semd_t {
 	struct list_head	s_procQ;
 } semd_t;
 
+/* Istogramma delle latenze di un device o di una linea (GETLATENCY) */
+typedef struct lat_hist_t {
+	U32 h_count[LAT_BUCKETS];
+	U32 h_max;
+} lat_hist_t;
+
+/* Statistiche dello scheduler di un processo (GETSCHEDSTATS) */
+typedef struct sched_stats_t {
+	int pid;
+	cpu_t cpu_time;
+	cpu_t user_time;
+	cpu_t sys_time;
+	cpu_t wait_time;
+	cpu_t quantum;
+	int adaptive;
+	U32 dispatches;
+	U32 preemptions;
+	U32 blocks;
+	int prio;
+	int effprio;
+	U32 boosts;
+} sched_stats_t;
+
+/* Statistiche del sistema (GETSYSSTATS) */
+typedef struct sys_stats_t {
+	/* Load average (virgola fissa, LOAD_SHIFT bit) */
+	U32 load_avg;
+	
+	/* Timer accorpati ad altri grazie allo slack, e interrupt dell'Interval Timer risparmiati */
+	U32 timer_coalesced;
+	U32 timer_irq_saved;
+	
+	/* Interrupt dei terminali risparmiati servendo trasmissione e ricezione insieme */
+	U32 term_irq_saved;
+	
+	/* Massimo tempo (microsecondi) dall'ingresso nel gestore degli interrupt alla fine delle top half */
+	U32 int_top_half_max;
+	
+	/* Massimo tempo (microsecondi) dall'ingresso nel gestore degli interrupt allo scheduler, e
+	   massimo tratto a interrupt mascherati senza interruzioni */
+	U32 int_handler_max;
+	U32 int_masked_max;
+	
+	/* Completamenti dei device persi a coda dei completamenti piena (e le loro V) */
+	U32 dev_ring_lost;
+} sys_stats_t;
+
+/* Semaforo usato come mutex con ereditarietà della priorità */
+typedef struct mutex_t {
+	/* Indirizzo del semaforo (NULL se la cella è libera) */
+	int *m_semAdd;
+	/* Processo che detiene il mutex */
+	pcb_t *m_owner;
+} mutex_t;
+
+/* Evento di ereditarietà della priorità */
+typedef struct pi_trace_t {
+	/* Processo che ha ricevuto la priorità */
+	int pi_owner;
+	/* Processo bloccato che l'ha ceduta */
+	int pi_waiter;
+	/* Priorità effettiva prima e dopo */
+	int pi_from;
+	int pi_to;
+	/* Posizione nella catena di blocco (0 = detentore diretto) */
+	int pi_depth;
+} pi_trace_t;
+
+/* Spinlock (uMPS2 CAS) */
+typedef struct spinlock_t {
+	unsigned int l_value;
+	
+	/* Posizione nell'ordine di acquisizione (LOCK_RANK_*) */
+	int l_rank;
+	
+	/* Acquisizioni, e quante di queste hanno trovato il lock occupato */
+	U32 l_acquired;
+	U32 l_contended;
+} spinlock_t;
+
+/* Trasmissione e ricezione di un terminale (WRITETERMINAL, READTERMINAL) */
+typedef struct term_t {
+	/* Preso a interrupt mascherati, anche dalla top half */
+	spinlock_t t_lock;
+	
+	/* Caratteri copiati dagli scrittori (o di eco) e non ancora trasmessi, ciascuno con lo
+	   scrittore che l'ha copiato (NULL per l'eco e per quelli di uno scrittore terminato) */
+	char t_txBuf[TERM_TX_SIZE];
+	pcb_t *t_txOwner[TERM_TX_SIZE];
+	U32 t_txHead;
+	U32 t_txCount;
+	
+	/* Trasmettitore al lavoro sulla coda, bottom half già accodata */
+	int t_txBusy;
+	int t_txWork;
+	
+	/* Scrittore di turno (il solo che copia nella coda) e se attende spazio per il resto */
+	pcb_t *t_txTurn;
+	int t_txWait;
+	
+	/* Uno scrittore non ha più caratteri nella coda (trasmessi o scartati) */
+	int t_txDone;
+	
+	/* Processi in attesa del turno, in ordine, e processi che hanno copiato tutto e
+	   attendono la trasmissione dei loro caratteri */
+	struct list_head t_writers;
+	struct list_head t_draining;
+	
+	/* Caratteri trasmessi e bottom half eseguite */
+	U32 t_txChars;
+	U32 t_txWakeups;
+	
+	/* Caratteri ricevuti e non ancora letti: gli ultimi t_rxPartial sono la riga in corso */
+	char t_rxBuf[TERM_RX_SIZE];
+	U32 t_rxHead;
+	U32 t_rxCount;
+	U32 t_rxPartial;
+	
+	/* Ricevitore pilotato dal nucleo, bottom half già accodata */
+	int t_rxActive;
+	int t_rxWork;
+	
+	/* Status dell'ultima ricezione fallita (0 se nessuna) */
+	U32 t_rxError;
+	
+	/* Processi in attesa di una riga, in ordine, e lettore svegliato per ripetere la
+	   READTERMINAL, che legge per primo */
+	struct list_head t_readers;
+	pcb_t *t_rxTurn;
+	
+	/* Caratteri ricevuti e scartati a coda piena */
+	U32 t_rxChars;
+	U32 t_rxLost;
+} term_t;
+
+/* Statistiche di un disco (GETDISKSTATS) */
+typedef struct disk_stats_t {
+	U32 requests;
+	U32 merged;
+	U32 transfers;
+	U32 errors;
+	U32 seeks;
+	U32 seek_dist;
+	cpu_t busy_time;
+	
+	/* Cache dei blocchi: accessi serviti e non, scritture differite, fallite e blocchi scartati */
+	U32 cache_hits;
+	U32 cache_misses;
+	U32 cache_writebacks;
+	U32 cache_wb_errors;
+	U32 cache_wb_dropped;
+} disk_stats_t;
+
+/* Blocco della cache dei dischi (DISK_PUT, DISK_GET) */
+typedef struct bcache_t {
+	/* Ordine LRU: in testa il blocco usato meno di recente */
+	struct list_head b_lru;
+	
+	/* Settore contenuto (b_disk -1 se il blocco è libero) */
+	int b_disk;
+	U32 b_sector;
+	
+	/* Dati presenti, modificati rispetto al disco */
+	int b_valid;
+	int b_dirty;
+	
+	/* Generazione dei dati (a ogni modifica) e generazione in scrittura sul disco */
+	U32 b_gen;
+	U32 b_wbGen;
+	int b_writing;
+	
+	/* Scritture sul disco fallite di seguito */
+	int b_wbFails;
+	
+	/* Richieste al disco in corso sul blocco */
+	int b_io;
+	
+	U32 b_data[PAGE_SIZE / WORD_SIZE];
+} bcache_t;
+
+/* Richiesta a un disco: i processi le cui richieste sono state accorpate la attendono insieme */
+typedef struct disk_req_t {
+	/* Coda del disco, lista dei completamenti o lista libera */
+	struct list_head r_next;
+	
+	int r_write;
+	U32 r_sector;
+	U32 r_cyl;
+	U32 r_head;
+	U32 r_sect;
+	
+	/* Status del completamento */
+	U32 r_status;
+	
+	/* Blocco della cache letto o scritto (i dati passano sempre da un blocco del nucleo) */
+	bcache_t *r_cache;
+	
+	/* Processi in attesa */
+	struct list_head r_waiters;
+} disk_req_t;
+
+/* Coda delle richieste di un disco (DISK_PUT, DISK_GET) */
+typedef struct disk_t {
+	/* Preso a interrupt mascherati, anche dalla top half */
+	spinlock_t k_lock;
+	
+	/* Richieste in attesa (in ordine di settore, o di arrivo con DISK_FIFO) e descrittori liberi */
+	struct list_head k_queue;
+	struct list_head k_free;
+	
+	/* Richiesta sul device, fase (DISK_*) e pagina DMA pronta per il suo trasferimento */
+	disk_req_t *k_cur;
+	int k_phase;
+	int k_ready;
+	
+	/* Richieste completate, in attesa della bottom half già accodata */
+	struct list_head k_done;
+	int k_work;
+	
+	/* Cilindro della testina e ultimo settore servito */
+	U32 k_cyl;
+	U32 k_last;
+	
+	/* Geometria */
+	U32 k_maxCyl;
+	U32 k_maxHead;
+	U32 k_maxSect;
+	
+	disk_stats_t k_stats;
+	tod_t k_busySince;
+} disk_t;
+
+/* Magazine di pcb liberi di una CPU */
+typedef struct pcb_mag_t {
+	pcb_t *m_pcb[MAG_SIZE];
+	int m_count;
+	
+	/* Preso dalla CPU proprietaria, e dalle altre solo se tutti i pcb liberi sono nei magazine */
+	spinlock_t m_lock;
+	
+	/* Trasferimenti a lotti da e verso la lista globale */
+	U32 m_refills;
+	U32 m_drains;
+} pcb_mag_t;
+
+/* Descrittore di un device (per i terminali, di una delle due metà), costruito all'avvio */
+typedef struct device_t {
+	/* Registro del device, NULL se il device non è installato */
+	devreg_t *d_reg;
+	
+	/* Semaforo del device e coda degli status dei completamenti non ancora ritirati (tanti
+	   quanto il valore del semaforo, se positivo) */
+	int *d_sem;
+	U32 d_ring[DEV_RING_SIZE];
+	U32 d_ringHead;
+	U32 d_ringCount;
+	U32 d_ringLost;
+	
+	/* Gestore dell'interrupt (NULL per la metà in ricezione dei terminali, servita insieme
+	   a quella in trasmissione) */
+	void (*d_handler)(struct device_t *d);
+	
+	/* Linea di interrupt e numero del device */
+	int d_line;
+	int d_dev;
+	
+#ifdef LAT_HIST
+	/* Ingresso nel gestore degli interrupt per l'ultimo interrupt del device */
+	tod_t d_latEntry;
+#endif
+} device_t;
+
+/* Lavoro differito di un interrupt (bottom half), eseguito prima di tornare allo scheduler */
+typedef struct work_t {
+	void (*w_func)(device_t *d, U32 status);
+	device_t *w_dev;
+	U32 w_status;
+} work_t;
+
+/* Stato del nucleo di ciascuna CPU */
+typedef struct cpu_data_t {
+	/* Processo in esecuzione e coda dei processi pronti della CPU */
+	pcb_t *c_current;
+	struct list_head c_readyQueue;
+	int c_readyCount;
+	spinlock_t c_readyLock;
+	
+	/* TRUE se la CPU detiene kernelLock, e lock detenuti (un bit per rank, con LOCK_DEBUG) */
+	int c_kernelLocked;
+	U32 c_locksHeld;
+	
+	/* Contabilità del tempo (vedi kernelEntry/kernelExit) */
+	tod_t c_now;
+	tod_t c_processTOD;
+	tod_t c_kernelTOD;
+	pcb_t *c_kernelProcess;
+	int c_kernelEntered;
+	
+	/* Scadenza del quanto (solo con una sola CPU: con più CPU si usa il timer locale) */
+	ktimer_t c_sliceTimer;
+	
+#ifdef LAT_HIST
+	/* Ingresso nel livello del gestore degli interrupt in servizio */
+	tod_t c_latEntry;
+#endif
+	
+	/* Coda circolare del lavoro differito degli interrupt */
+	work_t c_work[INT_WORK_MAX];
+	U32 c_workHead;
+	U32 c_workTail;
+	
+	/* Interrupt annidati: livello corrente (0 fuori dal gestore), stato salvato di ogni livello
+	   annidato, stack del nucleo della CPU e inizio del tratto a interrupt mascherati */
+	int c_intDepth;
+	state_t c_intSaved[INT_NEST_MAX];
+	memaddr c_intStack;
+	tod_t c_maskedSince;
+	
+	/* Old Areas delle eccezioni della CPU (e New Area degli interrupt) */
+	state_t *c_intOld;
+	state_t *c_intNew;
+	state_t *c_tlbOld;
+	state_t *c_pgmTrapOld;
+	state_t *c_sysBpOld;
+	
+	/* Statistiche */
+	U32 c_dispatches;
+	U32 c_steals;
+	U32 c_idle;
+	U32 c_kicksSent;
+	U32 c_kicksReceived;
+	U32 c_interrupts[INT_LINES];
+} cpu_data_t;
+
 /* Struttura per la tabella dei pcb utilizzati */
 typedef struct pcb_pid_t {
 	/* Pid del processo */
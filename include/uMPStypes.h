@@ -113,4 +113,7 @@ typedef struct {
 
 typedef U32 cpu_t;
 
+/* 64-bit monotonic kernel time, in microseconds since power on */
+typedef U64 tod_t;
+
 #endif
@@ -11,6 +11,7 @@ int insertBlocked(S32 *semAdd, pcb_t *p);
 pcb_t *removeBlocked(S32 *semAdd);
 pcb_t *outBlocked(pcb_t *p);
 pcb_t *headBlocked(S32 *semAdd);
+int blockedMaxPrio(S32 *semAdd, int prio);
 void initSemd(void);
 
 #endif
@@ -10,6 +10,7 @@
 #include <const.h>
 #include <types10.h>
 #include <listx.h>
+#include <lock.e>
 
 /*---------------------------------------------------------------------------------*/
 /* Dichiarazione delle variabili globali del asl.c */
@@ -25,6 +26,10 @@ HIDDEN struct list_head semdfree_h;
   * @brief Vettore dei descrittori di semafori disponibili.
  */
 HIDDEN semd_t semdtable[MAXPROC];
+/**
+  * @brief Lock della ASL e della lista dei descrittori inutilizzati.
+ */
+spinlock_t aslLock;
 /*---------------------------------------------------------------------------------*/
 
 /**
@@ -61,6 +66,7 @@ void initSemd(void)
 
 	INIT_LIST_HEAD(&semdfree_h);
 	INIT_LIST_HEAD(&semd_h);
+	lockInit(&aslLock, LOCK_RANK_ASL);
 
 	for (i=0; i<MAXPROC; i++)
 	{
@@ -79,7 +85,7 @@ void initSemd(void)
   * @return Restituisce vero (1) se un nuovo descrittore di semaforo deve essere allocato e la
   * lista di descrittori inutilizzati è vuota, altrimenti falso (0).
  */
-int insertBlocked(S32 *semAdd, pcb_t *p)
+HIDDEN int aslInsertBlocked(S32 *semAdd, pcb_t *p)
 {
 	semd_t *s, *slist;
 
@@ -128,6 +134,23 @@ int insertBlocked(S32 *semAdd, pcb_t *p)
 	}
 }
 
+/**
+  * @brief Come aslInsertBlocked(), in mutua esclusione sulla ASL (aslLock).
+  * @param semAdd : puntatore al descrittore di semaforo contenente la coda di pcb.
+  * @param p : puntatore al pcb da inserire nella coda di pcb di semAdd.
+  * @return Vedi aslInsertBlocked().
+ */
+int insertBlocked(S32 *semAdd, pcb_t *p)
+{
+	int ris;
+	
+	lockAcquire(&aslLock);
+	ris = aslInsertBlocked(semAdd, p);
+	lockRelease(&aslLock);
+	
+	return ris;
+}
+
 /**
   * @brief Rimuove il primo pcb dalla coda di pcb del descrittore di semaforo associato presente nella lista
   * ASL. Se la coda di pcb diventa vuota, rimuove il descrittore del semaforo dalla ASL e lo reinserisce nella
@@ -135,7 +158,7 @@ int insertBlocked(S32 *semAdd, pcb_t *p)
   * @param semAdd : puntatore al descrittore di semaforo contenente la coda di pcb.
   * @return Restituisce 'NULL' se il pcb non viene trovato nella coda di pcb, altrimenti un puntatore al pcb rimosso.
  */
-pcb_t *removeBlocked(S32 *semAdd)
+HIDDEN pcb_t *aslRemoveBlocked(S32 *semAdd)
 {
 	semd_t *s;
 	pcb_t *p;
@@ -163,12 +186,28 @@ pcb_t *removeBlocked(S32 *semAdd)
 	return NULL;
 }
 
+/**
+  * @brief Come aslRemoveBlocked(), in mutua esclusione sulla ASL (aslLock).
+  * @param semAdd : puntatore al descrittore di semaforo contenente la coda di pcb.
+  * @return Vedi aslRemoveBlocked().
+ */
+pcb_t *removeBlocked(S32 *semAdd)
+{
+	pcb_t *ris;
+	
+	lockAcquire(&aslLock);
+	ris = aslRemoveBlocked(semAdd);
+	lockRelease(&aslLock);
+	
+	return ris;
+}
+
 /**
   * @brief Rimuove il pcb specificato dalla coda di pcb del descrittore di semaforo associato.
   * @param p : puntatore al pcb da rimuovere.
   * @return Restituisce 'NULL' se il pcb non viene trovato nella coda di pcb, altrimenti un puntatore al pcb rimosso.
  */
-pcb_t *outBlocked(pcb_t *p)
+HIDDEN pcb_t *aslOutBlocked(pcb_t *p)
 {
 	semd_t *s;
 	pcb_t *p_aux;
@@ -191,13 +230,29 @@ pcb_t *outBlocked(pcb_t *p)
 	return NULL;
 }
 
+/**
+  * @brief Come aslOutBlocked(), in mutua esclusione sulla ASL (aslLock).
+  * @param p : puntatore al pcb da rimuovere.
+  * @return Vedi aslOutBlocked().
+ */
+pcb_t *outBlocked(pcb_t *p)
+{
+	pcb_t *ris;
+	
+	lockAcquire(&aslLock);
+	ris = aslOutBlocked(p);
+	lockRelease(&aslLock);
+	
+	return ris;
+}
+
 /**
   * @brief Preleva la testa della coda di pcb del descrittore del semaforo associato.
   * @param semAdd : puntatore al descrittore di semaforo contenente la coda di pcb.
   * @return Restituisce 'NULL' se il descrittore non è presente nella lista ASL oppure se la coda di
   * pcb associata ad esso è vuota, altrimenti la testa della coda di pcb.
  */
-pcb_t *headBlocked(S32 *semAdd)
+HIDDEN pcb_t *aslHeadBlocked(S32 *semAdd)
 {
 	semd_t *s;
 	pcb_t *p;
@@ -222,3 +277,47 @@ pcb_t *headBlocked(S32 *semAdd)
 
 	return NULL;
 }
+
+/**
+  * @brief Come aslHeadBlocked(), in mutua esclusione sulla ASL (aslLock).
+  * @param semAdd : puntatore al descrittore di semaforo contenente la coda di pcb.
+  * @return Vedi aslHeadBlocked().
+ */
+pcb_t *headBlocked(S32 *semAdd)
+{
+	pcb_t *ris;
+	
+	lockAcquire(&aslLock);
+	ris = aslHeadBlocked(semAdd);
+	lockRelease(&aslLock);
+	
+	return ris;
+}
+
+/**
+  * @brief Calcola la massima priorità effettiva tra una priorità data e quelle dei pcb bloccati
+  * su un semaforo. La coda viene scorsa in mutua esclusione sulla ASL (aslLock): una P o V
+  * concorrente (anche sui semafori dei device, sotto il solo devSemLock) può liberarne il descrittore.
+  * @param semAdd : puntatore al descrittore di semaforo.
+  * @param prio : priorità di partenza.
+  * @return Restituisce la massima tra prio e le priorità effettive dei pcb bloccati su semAdd.
+ */
+int blockedMaxPrio(S32 *semAdd, int prio)
+{
+	semd_t *s;
+	pcb_t *p;
+	
+	lockAcquire(&aslLock);
+	
+	list_for_each_entry(s, &semd_h, s_next)
+		if(s->s_semAdd==semAdd)
+		{
+			list_for_each_entry(p, &s->s_procQ, p_next)
+				if(p->p_effprio > prio) prio = p->p_effprio;
+			break;
+		}
+	
+	lockRelease(&aslLock);
+	
+	return prio;
+}
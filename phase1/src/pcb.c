@@ -10,6 +10,8 @@
 #include <types10.h>
 #include <listx.h>
 #include <pcb.e>
+#include <lock.e>
+#include <libumps.e>
 
 /*---------------------------------------------------------------------------------*/
 /* Dichiarazione delle variabili globali del pcb.c */
@@ -22,6 +24,14 @@ HIDDEN struct list_head pcbfree_h;
   * @brief Vettore dei pcb disponibili.
  */
 HIDDEN pcb_t pcbtable[MAXPROC];
+/**
+  * @brief Lock della lista dei pcb liberi.
+ */
+spinlock_t pcbLock;
+/**
+  * @brief Magazine di pcb liberi di ciascuna CPU.
+ */
+pcb_mag_t pcbMag[NCPU];
 
 /*---------------------------------------------------------------------------------*/
 
@@ -64,6 +74,33 @@ HIDDEN void newPcb(pcb_t *p)
 	
 	/* CPU_TIME of process */
 	p->p_cpu_time = 0;
+	p->p_slice_time = 0;
+	p->p_sys_time = 0;
+	p->p_wait_time = 0;
+	p->p_readyTOD = 0;
+	
+	/* Quanto di tempo e statistiche dello scheduler */
+	p->p_quantum = SCHED_TIME_SLICE;
+	p->p_adaptive = FALSE;
+	p->p_group = NULL;
+	p->p_cpu = 0;
+	p->p_affinity = AFFINITY_ALL;
+	p->p_sleep.k_tw.t_armed = FALSE;
+	p->p_slack = TIMER_SLACK_DEFAULT;
+#ifdef LAT_HIST
+	p->p_latDev = NULL;
+#endif
+	p->p_ioDone = 0;
+	p->p_ioDev = -1;
+	p->p_ioQueued = 0;
+	p->p_ioError = 0;
+	p->p_ioRestart = FALSE;
+	p->p_killed = FALSE;
+	p->p_prio = p->p_effprio = PRIO_DEFAULT;
+	p->p_boosts = 0;
+	p->p_dispatches = 0;
+	p->p_preemptions = 0;
+	p->p_blocks = 0;
 	
 	/* Exception State Vector */
 	for(i=0;i<MAX_STATE_VECTOR;i++)
@@ -74,13 +111,29 @@ HIDDEN void newPcb(pcb_t *p)
 }
 
 /**
-  * @brief Inserisce un pcb nella lista dei pcb liberi.
+  * @brief Inserisce un pcb nel magazine della CPU; se è pieno, MAG_BATCH pcb tornano nella lista dei pcb liberi.
   * @param p : puntatore al pcb da inserire.
   * @return void.
  */
 void freePcb(pcb_t *p)
 {
-	list_add(&p->p_next, &pcbfree_h);
+	pcb_mag_t *m = &pcbMag[CPU_ID];
+	
+	lockAcquire(&m->m_lock);
+	
+	/* Magazine pieno: MAG_BATCH pcb tornano nella lista globale */
+	if(m->m_count == MAG_SIZE)
+	{
+		lockAcquire(&pcbLock);
+		while(m->m_count > MAG_SIZE - MAG_BATCH)
+			list_add(&m->m_pcb[--m->m_count]->p_next, &pcbfree_h);
+		lockRelease(&pcbLock);
+		m->m_drains++;
+	}
+	
+	m->m_pcb[m->m_count++] = p;
+	
+	lockRelease(&m->m_lock);
 }
 
 /**
@@ -93,34 +146,68 @@ void initPcbs(void)
 	int i;
 
 	INIT_LIST_HEAD(&pcbfree_h);
+	lockInit(&pcbLock, LOCK_RANK_PCB);
+	
+	/* I magazine partono vuoti: si riempiranno al primo allocPcb() di ciascuna CPU */
+	for(i=0; i<NCPU; i++)
+	{
+		pcbMag[i].m_count = 0;
+		pcbMag[i].m_refills = pcbMag[i].m_drains = 0;
+		lockInit(&pcbMag[i].m_lock, LOCK_RANK_PCBMAG);
+	}
 
 	for(i=0; i<MAXPROC; i++)
 	{
 		p=&pcbtable[i];
-		freePcb(p);
+		list_add(&p->p_next, &pcbfree_h);
 	}
 }
 
 /**
-  * @brief Alloca un pcb rimuovendolo dalla lista dei pcb liberi.
+  * @brief Alloca un pcb prendendolo dal magazine della CPU, che si rifornisce a lotti dalla lista dei pcb liberi.
   * @return Restituisce un puntatore al pcb allocato oppure 'NULL' se la lista dei pcb liberi è vuota.
  */
 pcb_t *allocPcb(void)
 {
+	pcb_mag_t *m = &pcbMag[CPU_ID];
 	pcb_t *p;
+	int i;
 
-	/* Se la lista libera è vuota restituisce NULL */
-	if (list_empty(&pcbfree_h))
-		return NULL;
-	else
+	lockAcquire(&m->m_lock);
+	
+	/* Magazine vuoto: viene riempito con (al più) MAG_BATCH pcb dalla lista globale */
+	if(m->m_count == 0)
 	{
-		/* Altrimenti preleva il pcb dalla lista, lo rimuove, lo inizializza e lo restituisce */
-		p=container_of(pcbfree_h.next, pcb_t, p_next);
-		list_del(pcbfree_h.next);
-		newPcb(p);
-
-		return(p);
+		lockAcquire(&pcbLock);
+		while((m->m_count < MAG_BATCH) && !list_empty(&pcbfree_h))
+		{
+			m->m_pcb[m->m_count++] = container_of(pcbfree_h.next, pcb_t, p_next);
+			list_del(pcbfree_h.next);
+		}
+		lockRelease(&pcbLock);
+		m->m_refills++;
 	}
+	
+	p = (m->m_count > 0) ? m->m_pcb[--m->m_count] : NULL;
+	
+	lockRelease(&m->m_lock);
+	
+	/* Lista globale vuota: gli ultimi pcb liberi possono essere nei magazine delle altre CPU */
+	for(i=0; (p == NULL) && (i<NCPU); i++)
+	{
+		if(&pcbMag[i] == m) continue;
+		
+		lockAcquire(&pcbMag[i].m_lock);
+		if(pcbMag[i].m_count > 0) p = pcbMag[i].m_pcb[--pcbMag[i].m_count];
+		lockRelease(&pcbMag[i].m_lock);
+	}
+	
+	/* Se non ci sono pcb liberi restituisce NULL */
+	if(p == NULL) return NULL;
+	
+	newPcb(p);
+	
+	return(p);
 }
 
 /* Funzioni sulle code di pcb */
@@ -0,0 +1,23 @@
+/**
+ *  @file bcache.e
+ *  @author Vincenzo Ferrari - Barbara Iadarola
+ *  @brief File di definizione del modulo bcache.c
+ *  @note Contiene tutte le definizioni delle funzioni implementate nel modulo bcache.c
+ */
+ 
+#ifndef BCACHE_E
+#define BCACHE_E
+
+#include <types10.h>
+#include <listx.h>
+#include <const.h>
+
+void bcacheInit();
+int bcacheGet(char *buf, int disk, U32 sector);
+int bcachePut(char *buf, int disk, U32 sector);
+void bcacheDone(bcache_t *b, int write, U32 status, U32 *src, struct list_head *wake);
+int bcacheCancel(pcb_t *p);
+void bcacheFlush();
+void bcacheStats(int disk, disk_stats_t *stats);
+
+#endif
@@ -0,0 +1,28 @@
+/**
+ *  @file clock.e
+ *  @author Vincenzo Ferrari - Barbara Iadarola
+ *  @brief File di definizione del modulo clock.c
+ *  @note Contiene tutte le definizioni delle funzioni implementate nel modulo clock.c
+ */
+ 
+#ifndef CLOCK_E
+#define CLOCK_E
+
+#include <types10.h>
+#include <listx.h>
+#include <const.h>
+#include <cpu.e>
+
+/* Istante campionato all'ultimo ingresso nel nucleo della CPU corrente */
+#define kernelNow (thisCpu->c_now)
+
+void clockInit();
+U64 clockReadTicks();
+tod_t clockRead();
+tod_t clockSample();
+tod_t clockTicksToUs(U64 ticks);
+U32 clockUsToTicks(U32 us);
+void clockSetTimer(U32 us);
+void clockSetSliceTimer(U32 us);
+
+#endif
@@ -0,0 +1,46 @@
+/**
+ *  @file cpu.e
+ *  @author Vincenzo Ferrari - Barbara Iadarola
+ *  @brief File di definizione del modulo cpu.c
+ *  @note Contiene tutte le definizioni delle funzioni implementate nel modulo cpu.c
+ */
+ 
+#ifndef CPU_E
+#define CPU_E
+
+#include <types10.h>
+#include <listx.h>
+#include <const.h>
+
+extern cpu_data_t cpuData[NCPU];
+
+extern int cpuCount;
+
+#if NCPU > 1
+extern state_t cpuAreas[NCPU][CPU_STATE_AREAS];
+
+extern U32 cpuStacks[NCPU][KSTACK_SIZE / WORD_SIZE];
+#endif
+
+/* Stato del nucleo della CPU corrente */
+#define thisCpu (&cpuData[CPU_ID])
+
+#define currentProcess (thisCpu->c_current)
+#define readyQueue (thisCpu->c_readyQueue)
+#define processTOD (thisCpu->c_processTOD)
+#define kernelTOD (thisCpu->c_kernelTOD)
+#define kernelProcess (thisCpu->c_kernelProcess)
+#define kernelEntered (thisCpu->c_kernelEntered)
+
+/* Maschera di affinità delle CPU in uso (uMPS2 ne ha al più 16) */
+#define CPU_ONLINE_MASK (CPU_MASK(cpuCount) - 1)
+
+void cpuInit();
+int cpuBusy();
+void cpuKick(int cpu);
+void cpuKickAck();
+void irtInit();
+void irtRouteHere(int line, int dev);
+void cpuPublishLoad();
+
+#endif
@@ -0,0 +1,24 @@
+/**
+ *  @file disk.e
+ *  @author Vincenzo Ferrari - Barbara Iadarola
+ *  @brief File di definizione del modulo disk.c
+ *  @note Contiene tutte le definizioni delle funzioni implementate nel modulo disk.c
+ */
+ 
+#ifndef DISK_E
+#define DISK_E
+
+#include <types10.h>
+#include <listx.h>
+#include <const.h>
+
+void diskInit();
+int diskIntr(device_t *d);
+void diskCopy(U32 *dst, U32 *src);
+int diskCheck(char *buf, int disk, U32 sector);
+void diskRead(bcache_t *b);
+void diskWriteBack(bcache_t *b);
+void diskCancel(pcb_t *p);
+int getDiskStats(int disk, disk_stats_t *stats);
+
+#endif
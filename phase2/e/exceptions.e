@@ -19,13 +19,23 @@ int terminateProcess(int pid);
 void verhogen(int *semaddr);
 void passeren(int *semaddr);
 int getPid();
-cpu_t getCPUTime();
+cpu_t getCPUTime(int which);
 void waitClock();
+void delay(U32 us);
 unsigned int waitIO(int intlNo, int dnum, int waitForTermRead);
 int getPpid();
 void specTLBvect(state_t *oldp, state_t *newp);
 void specPGMvect(state_t *oldp, state_t *newp);
 void specSYSvect(state_t *oldp, state_t *newp);
+cpu_t setQuantum(cpu_t quantum, int adaptive);
+int getSchedStats(int pid, sched_stats_t *stats);
+int getSysStats(sys_stats_t *stats);
+int setQuota(int pid, cpu_t budget, cpu_t period);
+int setPriority(int pid, int prio);
+int mutexInit(int *semaddr, int enable);
+int setAffinity(int pid, U32 mask);
+int setSlack(int pid, U32 slack);
+void initMutexes();
 void pgmTrapHandler();
 void tlbHandler();
 void intHandler();
@@ -11,13 +11,10 @@
 #include <types10.h>
 #include <listx.h>
 #include <const.h>
+#include <cpu.e>
 
 extern void test(void);
 
-extern struct list_head readyQueue;
-
-extern pcb_t *currentProcess;
-
 extern U32 processCount;
 
 extern U32 pidCount;
@@ -33,15 +30,9 @@ extern struct {
 	int terminalT[8];
 } sem;
 
-extern int pseudo_clock;
-
-extern cpu_t processTOD;
+extern spinlock_t devSemLock;
 
-extern int statusWordDev[6][8];
-
-extern int timerTick;
-
-extern cpu_t startTimerTick;
+extern int pseudo_clock;
 
 extern pcb_pid_t pcbused_table[MAXPROC];
 
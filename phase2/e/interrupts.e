@@ -12,6 +12,17 @@
 #include <listx.h>
 #include <const.h>
 
+extern device_t devTable[DEV_TABLE_ROWS][DEV_PER_INT];
+extern U32 termIrqSaved;
+extern U32 intTopHalfMax;
+extern U32 intHandlerMax;
+extern U32 intMaskedMax;
+
 void intHandler();
+void intDevicesInit();
+U32 devRingGet(device_t *d);
+U32 devRingLost();
+void queueWork(void (*func)(device_t *d, U32 status), device_t *d, U32 status);
+void intTimersInit();
 
 #endif
@@ -0,0 +1,27 @@
+/**
+ *  @file ktimer.e
+ *  @author Vincenzo Ferrari - Barbara Iadarola
+ *  @brief File di definizione del modulo ktimer.c
+ *  @note Contiene tutte le definizioni delle funzioni implementate nel modulo ktimer.c
+ */
+ 
+#ifndef KTIMER_E
+#define KTIMER_E
+
+#include <types10.h>
+#include <listx.h>
+#include <const.h>
+
+extern U32 ktimerCoalesced;
+extern U32 ktimerIrqSaved;
+
+void ktimerInit(ktimer_t *k, void (*func)(ktimer_t *k));
+void ktimerArm(ktimer_t *k, tod_t when);
+void ktimerArmSlack(ktimer_t *k, tod_t when, U32 slack);
+void ktimerArmPeriodic(ktimer_t *k, tod_t first, U32 period);
+void ktimerCancel(ktimer_t *k);
+int ktimerRun();
+U32 ktimerNext();
+void ktimerProgram();
+
+#endif
@@ -0,0 +1,30 @@
+/**
+ *  @file latency.e
+ *  @author Vincenzo Ferrari - Barbara Iadarola
+ *  @brief File di definizione del modulo latency.c
+ *  @note Contiene tutte le definizioni delle funzioni implementate nel modulo latency.c.
+ *	  Senza -DLAT_HIST le funzioni di misura sono macro vuote.
+ */
+ 
+#ifndef LATENCY_E
+#define LATENCY_E
+
+#include <types10.h>
+#include <listx.h>
+#include <const.h>
+
+#ifdef LAT_HIST
+void latInit();
+void latAck(device_t *d);
+void latWake(device_t *d, pcb_t *p);
+void latDispatch(pcb_t *p);
+#else
+#define latInit()
+#define latAck(d)
+#define latWake(d, p)
+#define latDispatch(p)
+#endif
+
+int getLatency(int line, int dev, lat_hist_t *hist);
+
+#endif
@@ -0,0 +1,24 @@
+/**
+ *  @file lock.e
+ *  @author Vincenzo Ferrari - Barbara Iadarola
+ *  @brief File di definizione del modulo lock.c
+ *  @note Contiene tutte le definizioni delle funzioni implementate nel modulo lock.c
+ */
+ 
+#ifndef LOCK_E
+#define LOCK_E
+
+#include <types10.h>
+#include <listx.h>
+#include <const.h>
+
+extern spinlock_t kernelLock;
+
+void lockInit(spinlock_t *l, int rank);
+void lockAcquire(spinlock_t *l);
+void lockRelease(spinlock_t *l);
+void kernelLockAcquire();
+void kernelLockRelease();
+void atomicAdd(U32 *v, int delta);
+
+#endif
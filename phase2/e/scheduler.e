@@ -12,6 +12,22 @@
 #include <listx.h>
 #include <const.h>
 
+extern U32 loadAvg;
+
 void scheduler();
+void kernelEntry();
+void kernelExit();
+void insertReady(pcb_t *p);
+pcb_t *removeReady();
+pcb_t *outReady(pcb_t *p);
+void preemptCurrent(int expired);
+void setEffPriority(pcb_t *p, int prio);
+void setAffinityMask(pcb_t *p, U32 mask);
+int reapKilled();
+void initQuotaGroups();
+int quotaAssign(pcb_t *root, cpu_t budget, cpu_t period);
+void quotaLeave(pcb_t *p);
+void quotaTick();
+void initLoadAvg();
 
 #endif
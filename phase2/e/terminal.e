@@ -0,0 +1,23 @@
+/**
+ *  @file terminal.e
+ *  @author Vincenzo Ferrari - Barbara Iadarola
+ *  @brief File di definizione del modulo terminal.c
+ *  @note Contiene tutte le definizioni delle funzioni implementate nel modulo terminal.c
+ */
+ 
+#ifndef TERMINAL_E
+#define TERMINAL_E
+
+#include <types10.h>
+#include <listx.h>
+#include <const.h>
+
+void termInit();
+int termTxIntr(device_t *d);
+void termTxResume(device_t *d);
+int writeTerminal(char *buf, int len, int term);
+int termRxIntr(device_t *d);
+int readTerminal(char *buf, int len, int term);
+void termCancel(pcb_t *p);
+
+#endif
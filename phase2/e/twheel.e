@@ -0,0 +1,24 @@
+/**
+ *  @file twheel.e
+ *  @author Vincenzo Ferrari - Barbara Iadarola
+ *  @brief File di definizione del modulo twheel.c
+ *  @note Contiene tutte le definizioni delle funzioni implementate nel modulo twheel.c
+ */
+ 
+#ifndef TWHEEL_E
+#define TWHEEL_E
+
+#include <types10.h>
+#include <listx.h>
+#include <const.h>
+
+extern int twCount;
+
+void twInit(tod_t now);
+void twAdd(tw_timer_t *t, tod_t when);
+int twAddRange(tw_timer_t *t, tod_t when, tod_t latest);
+void twCancel(tw_timer_t *t);
+int twAdvance(tod_t now, void (*expire)(tw_timer_t *t));
+U32 twNextEvent(tod_t now);
+
+#endif
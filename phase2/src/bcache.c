@@ -0,0 +1,372 @@
+/**
+ *  @file bcache.c
+ *  @author Vincenzo Ferrari - Barbara Iadarola
+ *  @note Questo modulo implementa le SYS18 (DISK_PUT) e SYS19 (DISK_GET) sopra una cache di
+ *	  BCACHE_BLOCKS blocchi, indicizzata per (disco, settore), con sostituzione LRU e
+ *	  scrittura differita: una DISK_PUT modifica solo il blocco in cache, che viene scritto
+ *	  sul disco quando arriva in fondo all'ordine LRU e a ogni pseudo-clock tick. Una
+ *	  scrittura fallita viene ritentata al più BCACHE_WB_RETRIES volte, poi il blocco è scartato.
+ *	  Ogni accesso passa dalla cache, e i dati di un processo sono copiati solo nella sua
+ *	  SYSCALL: chi deve attendere (la lettura del blocco, o un blocco sostituibile) ripete la
+ *	  SYSCALL quando viene svegliato.
+ *	  Le funzioni vanno chiamate con kernelLock preso.
+ */
+
+/* Inclusioni phase1 */
+#include <pcb.e>
+
+/* Inclusioni phase2 */
+#include <bcache.e>
+#include <cpu.e>
+#include <disk.e>
+#include <initial.e>
+#include <lock.e>
+#include <scheduler.e>
+
+/* Inclusioni uMPS */
+#include <libumps.e>
+
+/**
+  * @brief Blocchi della cache
+ */
+HIDDEN bcache_t bcache[BCACHE_BLOCKS];
+
+/**
+  * @brief Ordine LRU dei blocchi: in testa il meno recente
+ */
+HIDDEN struct list_head bcacheLRU;
+
+/**
+  * @brief Processi in attesa di un blocco sostituibile o della lettura di un blocco
+ */
+HIDDEN struct list_head bcacheWaiters;
+
+/**
+  * @brief Accessi serviti dalla cache e accessi che hanno richiesto il disco, per disco
+ */
+HIDDEN U32 bcacheHits[DEV_PER_INT];
+HIDDEN U32 bcacheMisses[DEV_PER_INT];
+
+/**
+  * @brief Blocchi modificati scritti sul disco, per disco
+ */
+HIDDEN U32 bcacheWritebacks[DEV_PER_INT];
+
+/**
+  * @brief Scritture di blocchi modificati fallite, e blocchi scartati dopo BCACHE_WB_RETRIES fallimenti, per disco
+ */
+HIDDEN U32 bcacheWbErrors[DEV_PER_INT];
+HIDDEN U32 bcacheWbDropped[DEV_PER_INT];
+
+/**
+  * @brief Cerca il blocco di un settore.
+  * @param disk : numero del disco.
+  * @param sector : settore.
+  * @return Ritorna il blocco, NULL se il settore non è in cache.
+ */
+HIDDEN bcache_t *bcacheLookup(int disk, U32 sector)
+{
+	int i;
+	
+	for(i=0; i<BCACHE_BLOCKS; i++)
+		if((bcache[i].b_disk == disk) && (bcache[i].b_sector == sector)) return &bcache[i];
+	
+	return NULL;
+}
+
+/**
+  * @brief Sposta un blocco in fondo all'ordine LRU (usato più di recente).
+  * @param b : blocco.
+  * @return void.
+ */
+HIDDEN void bcacheTouch(bcache_t *b)
+{
+	list_del(&b->b_lru);
+	list_add_tail(&b->b_lru, &bcacheLRU);
+}
+
+/**
+  * @brief Avvia la scrittura sul disco di un blocco modificato, se non è già in corso.
+  * @param b : blocco.
+  * @return void.
+ */
+HIDDEN void bcacheWrite(bcache_t *b)
+{
+	if(!b->b_dirty || b->b_writing) return;
+	
+	b->b_writing = TRUE;
+	b->b_wbGen = b->b_gen;
+	b->b_io++;
+	bcacheWritebacks[b->b_disk]++;
+	
+	diskWriteBack(b);
+}
+
+/**
+  * @brief Sceglie il blocco da sostituire: il meno recente tra quelli non modificati e senza
+  *	   richieste al disco in corso. I blocchi modificati che lo precedono nell'ordine LRU
+  *	   vengono scritti sul disco, così da poter essere sostituiti in seguito.
+  * @return Ritorna il blocco, NULL se nessun blocco può essere sostituito subito.
+ */
+HIDDEN bcache_t *bcacheVictim()
+{
+	bcache_t *b;
+	
+	list_for_each_entry(b, &bcacheLRU, b_lru)
+	{
+		if(b->b_io > 0) continue;
+		if(!b->b_dirty) return b;
+		
+		bcacheWrite(b);
+	}
+	
+	return NULL;
+}
+
+/**
+  * @brief Assegna un blocco a un settore, come usato più di recente.
+  * @param b : blocco (non modificato, senza richieste in corso).
+  * @param disk : numero del disco.
+  * @param sector : settore.
+  * @return void.
+ */
+HIDDEN void bcacheTag(bcache_t *b, int disk, U32 sector)
+{
+	b->b_disk = disk;
+	b->b_sector = sector;
+	b->b_valid = FALSE;
+	b->b_wbFails = 0;
+	bcacheTouch(b);
+}
+
+/**
+  * @brief Blocca il processo corrente finché si conclude una richiesta su un blocco della cache:
+  *	   svegliato, ripeterà la SYSCALL.
+  * @param disk : numero del disco.
+  * @return void.
+ */
+HIDDEN void bcacheWait(int disk)
+{
+	pcb_t *p = currentProcess;
+	
+	p->p_state.pc_epc -= WORD_SIZE;
+	p->p_ioRestart = TRUE;
+	p->p_ioDev = disk;
+	insertProcQ(&bcacheWaiters, p);
+	p->p_isOnDev = IS_ON_DISK;
+	currentProcess = NULL;
+	atomicAdd(&softBlockCount, 1);
+	
+	scheduler();
+}
+
+/**
+  * @brief Conta un accesso alla cache, se non è la ripetizione di uno già contato.
+  * @param counter : contatore (hit o miss) del disco.
+  * @return void.
+ */
+HIDDEN void bcacheCount(U32 *counter)
+{
+	if(!currentProcess->p_ioRestart) (*counter)++;
+	currentProcess->p_ioRestart = FALSE;
+}
+
+/**
+  * @brief (SYS19) Legge un blocco di un disco. Se il settore non è in cache, il processo si
+  *	   blocca sulla lettura in un blocco della cache (o in attesa di un blocco sostituibile,
+  *	   o della lettura già in corso) e poi ripete la SYSCALL, che lo copia.
+  * @param buf : buffer che riceve il blocco (una pagina, allineato a parola).
+  * @param disk : numero del disco.
+  * @param sector : settore (cilindro, testina e settore linearizzati).
+  * @return Ritorna lo status del disco, il suo negato se la lettura è fallita, -1 se i parametri non sono validi o il disco non è installato.
+ */
+int bcacheGet(char *buf, int disk, U32 sector)
+{
+	bcache_t *b;
+	
+	if(!diskCheck(buf, disk, sector)) return -1;
+	
+	b = bcacheLookup(disk, sector);
+	if((b != NULL) && b->b_valid)
+	{
+		bcacheCount(&bcacheHits[disk]);
+		bcacheTouch(b);
+		diskCopy((U32 *) buf, b->b_data);
+		return DEV_S_READY;
+	}
+	
+	bcacheCount(&bcacheMisses[disk]);
+	
+	/* Il blocco è già in lettura, o nessun blocco è sostituibile subito */
+	if((b != NULL) || ((b = bcacheVictim()) == NULL))
+	{
+		bcacheWait(disk);
+		return 0;
+	}
+	
+	bcacheTag(b, disk, sector);
+	b->b_io++;
+	diskRead(b);
+	
+	return 0;
+}
+
+/**
+  * @brief (SYS18) Scrive un blocco di un disco nella cache: il blocco sarà scritto sul disco in
+  *	   seguito. Il processo si blocca solo se non ci sono blocchi sostituibili, e poi ripete
+  *	   la SYSCALL. Un errore del disco nella scrittura differita non viene più riportato al
+  *	   processo: è solo contato (GETDISKSTATS).
+  * @param buf : blocco da scrivere (una pagina, allineato a parola).
+  * @param disk : numero del disco.
+  * @param sector : settore (cilindro, testina e settore linearizzati).
+  * @return Ritorna DEV_S_READY, -1 se i parametri non sono validi o il disco non è installato.
+ */
+int bcachePut(char *buf, int disk, U32 sector)
+{
+	bcache_t *b;
+	
+	if(!diskCheck(buf, disk, sector)) return -1;
+	
+	/* Anche un blocco in lettura: i dati letti non sostituiranno quelli scritti */
+	if((b = bcacheLookup(disk, sector)) != NULL) bcacheCount(&bcacheHits[disk]);
+	else
+	{
+		bcacheCount(&bcacheMisses[disk]);
+		if((b = bcacheVictim()) == NULL)
+		{
+			bcacheWait(disk);
+			return 0;
+		}
+		bcacheTag(b, disk, sector);
+	}
+	
+	diskCopy(b->b_data, (U32 *) buf);
+	b->b_valid = TRUE;
+	b->b_dirty = TRUE;
+	b->b_gen++;
+	bcacheTouch(b);
+	
+	return DEV_S_READY;
+}
+
+/**
+  * @brief Chiamata dal modulo disk.c quando si conclude una richiesta al disco su un blocco
+  *	   della cache. Una lettura riempie il blocco (se nel frattempo non è stato scritto), una
+  *	   scrittura lo rende non modificato se i dati non sono cambiati da quando è partita.
+  *	   Un blocco la cui lettura è fallita torna libero; una scrittura fallita sarà ritentata,
+  *	   ma dopo BCACHE_WB_RETRIES fallimenti di seguito il blocco viene scartato, con i suoi
+  *	   dati: altrimenti resterebbe modificato, e insostituibile, per sempre.
+  *	   I processi in attesa di un blocco passano in wake, e ripeteranno la SYSCALL.
+  * @param b : blocco.
+  * @param write : TRUE per una scrittura, FALSE per una lettura.
+  * @param status : status del completamento.
+  * @param src : blocco letto (per una lettura riuscita).
+  * @param wake : lista dei processi da svegliare.
+  * @return void.
+ */
+void bcacheDone(bcache_t *b, int write, U32 status, U32 *src, struct list_head *wake)
+{
+	int ok = ((status & CHECK_STATUS_BIT) == DEV_S_READY);
+	pcb_t *p;
+	
+	b->b_io--;
+	
+	while((p = removeProcQ(&bcacheWaiters)) != NULL) insertProcQ(wake, p);
+	
+	if(write)
+	{
+		b->b_writing = FALSE;
+		if(ok)
+		{
+			b->b_wbFails = 0;
+			if(b->b_gen == b->b_wbGen) b->b_dirty = FALSE;
+		}
+		else
+		{
+			bcacheWbErrors[b->b_disk]++;
+			if(++b->b_wbFails >= BCACHE_WB_RETRIES)
+			{
+				bcacheWbDropped[b->b_disk]++;
+				b->b_dirty = b->b_valid = FALSE;
+				b->b_disk = -1;
+				b->b_wbFails = 0;
+			}
+		}
+	}
+	else if(!b->b_valid)
+	{
+		if(ok)
+		{
+			diskCopy(b->b_data, src);
+			b->b_valid = TRUE;
+			/* Il processo che l'ha chiesto lo ritroverà ripetendo la SYSCALL */
+			bcacheTouch(b);
+		}
+		else b->b_disk = -1;
+	}
+}
+
+/**
+  * @brief Toglie un processo terminato dall'attesa di un blocco della cache.
+  * @param p : processo bloccato con IS_ON_DISK.
+  * @return Ritorna TRUE se il processo era in attesa di un blocco, FALSE altrimenti.
+ */
+int bcacheCancel(pcb_t *p)
+{
+	return (outProcQ(&bcacheWaiters, p) != NULL);
+}
+
+/**
+  * @brief Scrive sul disco tutti i blocchi modificati (a ogni pseudo-clock tick).
+  * @return void.
+ */
+void bcacheFlush()
+{
+	int i;
+	
+	for(i=0; i<BCACHE_BLOCKS; i++) bcacheWrite(&bcache[i]);
+}
+
+/**
+  * @brief Riporta le statistiche della cache per un disco (GETDISKSTATS).
+  * @param disk : numero del disco (valido).
+  * @param stats : statistiche da completare.
+  * @return void.
+ */
+void bcacheStats(int disk, disk_stats_t *stats)
+{
+	stats->cache_hits = bcacheHits[disk];
+	stats->cache_misses = bcacheMisses[disk];
+	stats->cache_writebacks = bcacheWritebacks[disk];
+	stats->cache_wb_errors = bcacheWbErrors[disk];
+	stats->cache_wb_dropped = bcacheWbDropped[disk];
+}
+
+/**
+  * @brief Inizializza la cache: tutti i blocchi liberi.
+  * @return void.
+ */
+void bcacheInit()
+{
+	int i;
+	
+	INIT_LIST_HEAD(&bcacheLRU);
+	INIT_LIST_HEAD(&bcacheWaiters);
+	
+	for(i=0; i<BCACHE_BLOCKS; i++)
+	{
+		bcache[i].b_disk = -1;
+		bcache[i].b_sector = 0;
+		bcache[i].b_valid = bcache[i].b_dirty = bcache[i].b_writing = FALSE;
+		bcache[i].b_gen = bcache[i].b_wbGen = 0;
+		bcache[i].b_io = 0;
+		bcache[i].b_wbFails = 0;
+		list_add_tail(&bcache[i].b_lru, &bcacheLRU);
+	}
+	
+	for(i=0; i<DEV_PER_INT; i++)
+	{
+		bcacheHits[i] = bcacheMisses[i] = bcacheWritebacks[i] = 0;
+		bcacheWbErrors[i] = bcacheWbDropped[i] = 0;
+	}
+}
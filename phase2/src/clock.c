@@ -0,0 +1,128 @@
+/**
+ *  @file clock.c
+ *  @author Vincenzo Ferrari - Barbara Iadarola
+ *  @note Questo modulo implementa l'orologio monotono a 64 bit del nucleo.
+ *	  Il TOD viene letto per intero (TODHI/TODLO) e convertito in microsecondi
+ *	  con un moltiplicatore precalcolato, senza divisioni sul percorso critico.
+ */
+
+/* Inclusioni phase2 */
+#include <clock.e>
+#include <ktimer.e>
+
+/* Inclusioni uMPS */
+#include <libumps.e>
+
+/**
+  * @brief Moltiplicatore per la conversione da tick a microsecondi (2^CLOCK_SHIFT / BUS_TIMESCALE)
+ */
+HIDDEN U32 clockMult;
+
+/**
+  * @brief Tick del processore per microsecondo (copia di BUS_TIMESCALE)
+ */
+HIDDEN U32 clockTicksPerUs;
+
+/**
+  * @brief Inizializza l'orologio del nucleo. Unica divisione dell'intero modulo.
+  * @return void.
+ */
+void clockInit()
+{
+	clockTicksPerUs = *((U32 *) BUS_TIMESCALE);
+	
+	/* Caso anomalo: il bus dichiara 0 tick per microsecondo */
+	if(clockTicksPerUs == 0) PANIC();
+	
+	clockMult = (1 << CLOCK_SHIFT) / clockTicksPerUs;
+	
+	clockSample();
+}
+
+/**
+  * @brief Legge il TOD a 64 bit in modo consistente: se la parte alta cambia durante la lettura
+  *	   della parte bassa (riporto), la lettura viene ripetuta.
+  * @return Ritorna i tick trascorsi dall'accensione.
+ */
+U64 clockReadTicks()
+{
+	U32 hi, lo;
+	
+	do {
+		hi = *((U32 *) BUS_TODHIGH);
+		lo = *((U32 *) BUS_TODLOW);
+	} while(hi != *((U32 *) BUS_TODHIGH));
+	
+	return (((U64) hi) << 32) | lo;
+}
+
+/**
+  * @brief Converte tick in microsecondi senza divisioni.
+  *	   (hi * 2^32 + lo) * mult >> CLOCK_SHIFT viene calcolato a pezzi per non uscire dai 64 bit.
+  * @param ticks : tick da convertire.
+  * @return Ritorna i microsecondi corrispondenti.
+ */
+tod_t clockTicksToUs(U64 ticks)
+{
+	U32 hi = (U32) (ticks >> 32);
+	U32 lo = (U32) ticks;
+	
+	return ((((U64) hi) * clockMult) << (32 - CLOCK_SHIFT)) + ((((U64) lo) * clockMult) >> CLOCK_SHIFT);
+}
+
+/**
+  * @brief Converte microsecondi in tick (solo una moltiplicazione).
+  * @param us : microsecondi da convertire.
+  * @return Ritorna i tick corrispondenti.
+ */
+U32 clockUsToTicks(U32 us)
+{
+	return us * clockTicksPerUs;
+}
+
+/**
+  * @brief Legge l'istante corrente, in microsecondi.
+  * @return Ritorna l'istante corrente.
+ */
+tod_t clockRead()
+{
+	return clockTicksToUs(clockReadTicks());
+}
+
+/**
+  * @brief Campiona l'istante corrente in kernelNow: all'interno del nucleo le altre funzioni
+  *	   usano questo valore invece di rileggere il TOD.
+  * @return Ritorna l'istante campionato.
+ */
+tod_t clockSample()
+{
+	kernelNow = clockRead();
+	return kernelNow;
+}
+
+/**
+  * @brief Carica l'Interval Timer con il valore passato (in microsecondi).
+  * @param us : microsecondi prima dell'interrupt del timer.
+  * @return void.
+ */
+void clockSetTimer(U32 us)
+{
+	*((U32 *) BUS_INTERVALTIMER) = clockUsToTicks(us);
+}
+
+/**
+  * @brief Carica il timer del quanto con il valore passato (in microsecondi).
+  *	   Con più CPU ciascuna usa il proprio timer locale, e l'Interval Timer (condiviso)
+  *	   serve solo i timer del nucleo; con una sola CPU il quanto è uno di essi.
+  * @param us : microsecondi prima dell'interrupt del timer (TIMER_INFINITE per nessuno).
+  * @return void.
+ */
+void clockSetSliceTimer(U32 us)
+{
+#if NCPU > 1
+	setTIMER((us == TIMER_INFINITE) ? TIMER_INFINITE : clockUsToTicks(us));
+#else
+	if(us == TIMER_INFINITE) ktimerCancel(&thisCpu->c_sliceTimer);
+	else ktimerArm(&thisCpu->c_sliceTimer, kernelNow + us);
+#endif
+}
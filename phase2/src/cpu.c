@@ -0,0 +1,207 @@
+/**
+ *  @file cpu.c
+ *  @author Vincenzo Ferrari - Barbara Iadarola
+ *  @note Questo modulo gestisce lo stato del nucleo di ciascuna CPU (uMPS2 multiprocessore):
+ *	  processo in esecuzione, Ready Queue, contabilità del tempo, Old Areas e stack del nucleo.
+ */
+
+/* Inclusioni phase1 */
+#include <pcb.e>
+
+/* Inclusioni phase2 */
+#include <cpu.e>
+#include <lock.e>
+
+/* Inclusioni uMPS */
+#include <libumps.e>
+
+/**
+  * @brief Stato del nucleo di ciascuna CPU
+ */
+cpu_data_t cpuData[NCPU];
+
+/**
+  * @brief Numero di CPU effettivamente utilizzate (al più NCPU)
+ */
+int cpuCount;
+
+#if NCPU > 1
+/**
+  * @brief New/Old Areas delle CPU diverse dalla 0 (la CPU 0 usa la ROM Reserved Frame)
+ */
+state_t cpuAreas[NCPU][CPU_STATE_AREAS];
+
+/**
+  * @brief Stack del nucleo delle CPU diverse dalla 0 (la CPU 0 usa RAMTOP)
+ */
+U32 cpuStacks[NCPU][KSTACK_SIZE / WORD_SIZE];
+
+/**
+  * @brief Copia della destinazione statica di ciascun device delle linee 3-7, per non
+  *	   riscrivere la Interrupt Routing Table quando non cambia
+ */
+HIDDEN int irtCpu[DEV_USED_INTS][DEV_PER_INT];
+#endif
+
+/**
+  * @brief Inizializza lo stato del nucleo di tutte le CPU.
+  * @return void.
+ */
+void cpuInit()
+{
+	cpu_data_t *c;
+	int i, j;
+	
+#if NCPU > 1
+	cpuCount = MIN(NCPU, *((int *) MCTL_NCPUS));
+#else
+	cpuCount = 1;
+#endif
+	
+	for(i=0; i<NCPU; i++)
+	{
+		c = &cpuData[i];
+		
+		c->c_current = NULL;
+		mkEmptyProcQ(&c->c_readyQueue);
+		c->c_readyCount = 0;
+		lockInit(&c->c_readyLock, LOCK_RANK_READY + i);
+		c->c_kernelLocked = FALSE;
+		c->c_locksHeld = 0;
+		c->c_kernelProcess = NULL;
+		c->c_kernelEntered = FALSE;
+		c->c_dispatches = c->c_steals = c->c_idle = 0;
+		c->c_kicksSent = c->c_kicksReceived = 0;
+		c->c_workHead = c->c_workTail = 0;
+		c->c_intDepth = 0;
+		for(j=0; j<INT_LINES; j++)
+			c->c_interrupts[j] = 0;
+		
+		if(i == 0)
+		{
+			c->c_intOld = (state_t *) INT_OLDAREA;
+			c->c_intNew = (state_t *) INT_NEWAREA;
+			c->c_intStack = RAMTOP;
+			c->c_tlbOld = (state_t *) TLB_OLDAREA;
+			c->c_pgmTrapOld = (state_t *) PGMTRAP_OLDAREA;
+			c->c_sysBpOld = (state_t *) SYSBK_OLDAREA;
+		}
+#if NCPU > 1
+		else
+		{
+			c->c_intOld = &cpuAreas[i][AREA_INT_OLD];
+			c->c_intNew = &cpuAreas[i][AREA_INT_NEW];
+			c->c_intStack = (memaddr) &cpuStacks[i][KSTACK_SIZE / WORD_SIZE];
+			c->c_tlbOld = &cpuAreas[i][AREA_TLB_OLD];
+			c->c_pgmTrapOld = &cpuAreas[i][AREA_PGMTRAP_OLD];
+			c->c_sysBpOld = &cpuAreas[i][AREA_SYSBK_OLD];
+		}
+#endif
+	}
+}
+
+/**
+  * @brief Conta le CPU che stanno eseguendo un processo.
+  * @return Ritorna il numero di CPU occupate.
+ */
+int cpuBusy()
+{
+	int i, n;
+	
+	n = 0;
+	for(i=0; i<cpuCount; i++)
+		if(cpuData[i].c_current != NULL) n++;
+	
+	return n;
+}
+
+/**
+  * @brief Invia un interrupt inter-processore (linea 0) a un'altra CPU, così che rientri nello
+  *	   scheduler senza attendere il proprio timer (processo svegliato, migrato o terminato).
+  * @param cpu : numero della CPU da svegliare.
+  * @return void.
+ */
+void cpuKick(int cpu)
+{
+#if NCPU > 1
+	if((cpu == CPU_ID) || (cpu >= cpuCount)) return;
+	
+	*((U32 *) CPUCTL_OUTBOX) = (CPU_MASK(cpu) << IPI_RECIPIENTS_SHIFT) | IPI_RESCHEDULE;
+	thisCpu->c_kicksSent++;
+#endif
+}
+
+/**
+  * @brief Riconosce un interrupt inter-processore ricevuto dalla CPU corrente. Il messaggio non
+  *	   richiede altre azioni: basta che la CPU passi dallo scheduler.
+  * @return void.
+ */
+void cpuKickAck()
+{
+#if NCPU > 1
+	*((U32 *) CPUCTL_INBOX) = 0;
+	thisCpu->c_kicksReceived++;
+#endif
+}
+
+/**
+  * @brief Programma la Interrupt Routing Table. L'Interval Timer (pseudo-clock) va alla CPU 0;
+  *	   i device delle linee 3-7 sono distribuiti a turno tra le CPU, oppure, con IRT_DYNAMIC,
+  *	   vanno alla CPU meno carica tra tutte.
+  * @return void.
+ */
+void irtInit()
+{
+#if NCPU > 1
+	int line, dev;
+	
+	*((U32 *) IRT_ENTRY(INT_TIMER, 0)) = 0;
+	
+	for(line=INT_LOWEST; line<=INT_TERMINAL; line++)
+		for(dev=0; dev<DEV_PER_INT; dev++)
+		{
+			irtCpu[line - DEV_DIFF][dev] = ((line - DEV_DIFF) * DEV_PER_INT + dev) % cpuCount;
+			
+			if(IRT_DYNAMIC)
+				*((U32 *) IRT_ENTRY(line, dev)) = IRT_RP_DYNAMIC | CPU_ONLINE_MASK;
+			else
+				*((U32 *) IRT_ENTRY(line, dev)) = irtCpu[line - DEV_DIFF][dev];
+		}
+#endif
+}
+
+/**
+  * @brief Instrada gli interrupt di un device verso la CPU corrente, su cui gira il processo che
+  *	   ne attende il completamento (e su cui verrà risvegliato). Non ha effetto con IRT_DYNAMIC.
+  * @param line : linea di interrupt del device (3-7).
+  * @param dev : numero del device.
+  * @return void.
+ */
+void irtRouteHere(int line, int dev)
+{
+#if NCPU > 1
+	int self = CPU_ID;
+	
+	if(IRT_DYNAMIC || (irtCpu[line - DEV_DIFF][dev] == self)) return;
+	
+	irtCpu[line - DEV_DIFF][dev] = self;
+	*((U32 *) IRT_ENTRY(line, dev)) = self;
+#endif
+}
+
+/**
+  * @brief Pubblica il carico della CPU corrente (processi pronti più quello in esecuzione) nel suo
+  *	   Task Priority Register, usato dall'instradamento dinamico degli interrupt.
+  * @return void.
+ */
+void cpuPublishLoad()
+{
+#if NCPU > 1
+	U32 load;
+	
+	if(!IRT_DYNAMIC) return;
+	
+	load = thisCpu->c_readyCount + (currentProcess != NULL);
+	*((U32 *) CPUCTL_TPR) = MIN(load, TPR_MAX);
+#endif
+}
@@ -0,0 +1,544 @@
+/**
+ *  @file disk.c
+ *  @author Vincenzo Ferrari - Barbara Iadarola
+ *  @note Questo modulo implementa l'accesso ai dischi sotto le SYS18 (DISK_PUT) e SYS19
+ *	  (DISK_GET), vedi bcache.c: le richieste a ogni disco vengono accodate e servite con
+ *	  l'algoritmo C-LOOK, accorpando quelle sullo stesso settore. La top half dell'interrupt
+ *	  dà subito il comando successivo (SEEKCYL, poi READBLK o WRITEBLK); la bottom half copia
+ *	  i blocchi tra la pagina DMA del disco e i blocchi della cache, e sveglia i processi
+ *	  serviti, che ripetono la SYSCALL: i dati di un processo sono toccati solo nel suo contesto.
+ */
+
+/* Inclusioni phase1 */
+#include <pcb.e>
+
+/* Inclusioni phase2 */
+#include <bcache.e>
+#include <clock.e>
+#include <cpu.e>
+#include <disk.e>
+#include <initial.e>
+#include <interrupts.e>
+#include <latency.e>
+#include <lock.e>
+#include <scheduler.e>
+
+/* Inclusioni uMPS */
+#include <libumps.e>
+
+/**
+  * @brief Code delle richieste, per disco
+ */
+HIDDEN disk_t disks[DEV_PER_INT];
+
+/**
+  * @brief Descrittori delle richieste, per disco
+ */
+HIDDEN disk_req_t diskReqs[DEV_PER_INT][DISK_REQS];
+
+/**
+  * @brief Prende il lock di un disco a interrupt mascherati: la top half dello stesso disco non
+  *	   può interrompere chi lo detiene.
+  * @param k : disco.
+  * @return Ritorna lo Status da ripristinare con diskUnlock.
+ */
+HIDDEN U32 diskLock(disk_t *k)
+{
+	U32 s = getSTATUS();
+	
+	setSTATUS(s & ~STATUS_IEc);
+	lockAcquire(&k->k_lock);
+	
+	return s;
+}
+
+/**
+  * @brief Rilascia il lock di un disco e ripristina lo Status.
+  * @param k : disco.
+  * @param s : Status ritornato da diskLock.
+  * @return void.
+ */
+HIDDEN void diskUnlock(disk_t *k, U32 s)
+{
+	lockRelease(&k->k_lock);
+	setSTATUS(s);
+}
+
+/**
+  * @brief Copia un blocco (una pagina, a parole).
+  * @param dst : destinazione.
+  * @param src : sorgente.
+  * @return void.
+ */
+void diskCopy(U32 *dst, U32 *src)
+{
+	int i;
+	
+	for(i=0; i<(PAGE_SIZE / WORD_SIZE); i++) dst[i] = src[i];
+}
+
+/**
+  * @brief Inserisce una richiesta nella coda del disco: in ordine di settore (dopo quelle per lo
+  *	   stesso settore), o in ordine di arrivo con DISK_FIFO.
+  * @param k : disco.
+  * @param r : richiesta.
+  * @return void.
+ */
+HIDDEN void diskEnqueue(disk_t *k, disk_req_t *r)
+{
+#ifdef DISK_FIFO
+	list_add_tail(&r->r_next, &k->k_queue);
+#else
+	disk_req_t *q;
+	
+	list_for_each_entry(q, &k->k_queue, r_next)
+		if(q->r_sector > r->r_sector) break;
+	
+	/* Davanti a q, o in fondo se la coda è stata scorsa tutta */
+	list_add_tail(&r->r_next, &q->r_next);
+#endif
+}
+
+/**
+  * @brief Sceglie la prossima richiesta da servire. C-LOOK: la prima oltre l'ultimo settore
+  *	   servito; se non ce ne sono, la testina torna alla richiesta più bassa.
+  * @param k : disco.
+  * @return Ritorna la richiesta, NULL se la coda è vuota.
+ */
+HIDDEN disk_req_t *diskNext(disk_t *k)
+{
+#ifndef DISK_FIFO
+	disk_req_t *r;
+#endif
+	
+	if(list_empty(&k->k_queue)) return NULL;
+	
+#ifndef DISK_FIFO
+	list_for_each_entry(r, &k->k_queue, r_next)
+		if(r->r_sector > k->k_last) return r;
+#endif
+
+	return container_of(k->k_queue.next, disk_req_t, r_next);
+}
+
+/**
+  * @brief Dà il comando di trasferimento della richiesta corrente, se la pagina DMA è pronta;
+  *	   altrimenti la richiesta attende la bottom half (DISK_WAIT).
+  * @param k : disco.
+  * @param reg : registro del disco.
+  * @return Ritorna TRUE se è stato dato un comando, FALSE altrimenti.
+ */
+HIDDEN int diskXfer(disk_t *k, dtpreg_t *reg)
+{
+	if(!k->k_ready)
+	{
+		k->k_phase = DISK_WAIT;
+		return FALSE;
+	}
+	
+	k->k_phase = DISK_XFER;
+	reg->data0 = DISK_DMA_BUF(k - disks);
+	reg->command = DISK_XFER_CMD(k->k_cur->r_head, k->k_cur->r_sect, k->k_cur->r_write);
+	
+	return TRUE;
+}
+
+/**
+  * @brief Avvia la prossima richiesta della coda: posizionamento se la testina è su un altro
+  *	   cilindro, altrimenti direttamente il trasferimento. Va chiamata con il lock del disco,
+  *	   senza una richiesta sul device.
+  * @param k : disco.
+  * @param reg : registro del disco.
+  * @return Ritorna TRUE se è stato dato un comando, FALSE altrimenti.
+ */
+HIDDEN int diskStart(disk_t *k, dtpreg_t *reg)
+{
+	disk_req_t *r;
+	
+	if((r = diskNext(k)) == NULL)
+	{
+		if(k->k_phase != DISK_IDLE) k->k_stats.busy_time += kernelNow - k->k_busySince;
+		k->k_phase = DISK_IDLE;
+		k->k_cur = NULL;
+		return FALSE;
+	}
+	
+	if(k->k_phase == DISK_IDLE) k->k_busySince = kernelNow;
+	
+	list_del(&r->r_next);
+	k->k_cur = r;
+	k->k_last = r->r_sector;
+	
+	/* Una lettura può usare subito la pagina DMA, se nessun blocco letto attende di esserne copiato */
+	k->k_ready = !r->r_write && list_empty(&k->k_done);
+	
+	if(r->r_cyl != k->k_cyl)
+	{
+		k->k_stats.seeks++;
+		k->k_stats.seek_dist += (r->r_cyl > k->k_cyl) ? (r->r_cyl - k->k_cyl) : (k->k_cyl - r->r_cyl);
+		k->k_phase = DISK_SEEK;
+		reg->command = DISK_SEEK_CMD(r->r_cyl);
+		return TRUE;
+	}
+	
+	return diskXfer(k, reg);
+}
+
+/**
+  * @brief Consegna le richieste completate alla cache (copiandovi il blocco letto dalla pagina
+  *	   DMA) e sveglia i processi in attesa, e prepara la pagina DMA per la richiesta sul
+  *	   device (copiandovi il blocco della cache da scrivere), avviandone il trasferimento se
+  *	   era in attesa. Le copie avvengono senza il lock del disco: finché k_ready è falso il
+  *	   device non usa la pagina DMA. Va chiamata con kernelLock, che la serializza con
+  *	   diskRead, diskWriteBack e diskCancel.
+  * @param k : disco.
+  * @param d : descrittore del disco.
+  * @return void.
+ */
+HIDDEN void diskService(disk_t *k, device_t *d)
+{
+	struct list_head done, wake;
+	disk_req_t *r, *cur;
+	pcb_t *p;
+	U32 s;
+	
+	INIT_LIST_HEAD(&done);
+	mkEmptyProcQ(&wake);
+	
+	s = diskLock(k);
+	while(!list_empty(&k->k_done))
+	{
+		r = container_of(k->k_done.next, disk_req_t, r_next);
+		list_del(&r->r_next);
+		list_add_tail(&r->r_next, &done);
+	}
+	cur = ((k->k_cur != NULL) && !k->k_ready) ? k->k_cur : NULL;
+	diskUnlock(k, s);
+	
+	list_for_each_entry(r, &done, r_next)
+	{
+		/* Solo letture: chi riesce ripete la SYSCALL, e trova il blocco in cache */
+		while((p = removeProcQ(&r->r_waiters)) != NULL)
+		{
+			if((r->r_status & CHECK_STATUS_BIT) == DEV_S_READY) p->p_state.pc_epc -= WORD_SIZE;
+			else
+			{
+				p->p_state.reg_v0 = -(int) (r->r_status & CHECK_STATUS_BIT);
+				p->p_ioRestart = FALSE;
+			}
+			
+			insertProcQ(&wake, p);
+		}
+		
+		/* Il blocco letto è ancora nella pagina DMA */
+		bcacheDone(r->r_cache, r->r_write, r->r_status, (U32 *) DISK_DMA_BUF(d->d_dev), &wake);
+	}
+	
+	if((cur != NULL) && cur->r_write) diskCopy((U32 *) DISK_DMA_BUF(d->d_dev), cur->r_cache->b_data);
+	
+	s = diskLock(k);
+	while(!list_empty(&done))
+	{
+		r = container_of(done.next, disk_req_t, r_next);
+		list_del(&r->r_next);
+		list_add(&r->r_next, &k->k_free);
+	}
+	if((cur != NULL) && (k->k_cur == cur))
+	{
+		k->k_ready = TRUE;
+		if(k->k_phase == DISK_WAIT) diskXfer(k, &d->d_reg->dtp);
+	}
+	diskUnlock(k, s);
+	
+	while((p = removeProcQ(&wake)) != NULL)
+	{
+		latWake(d, p);
+		atomicAdd(&softBlockCount, -1);
+		insertReady(p);
+	}
+}
+
+/**
+  * @brief (Bottom half) Consegna le richieste completate e prepara la pagina DMA.
+  * @param d : descrittore del disco.
+  * @param status : non usato.
+  * @return void.
+ */
+HIDDEN void diskWork(device_t *d, U32 status)
+{
+	disk_t *k = &disks[d->d_dev];
+	U32 s;
+	
+	/* Rilasciato da kernelExit */
+	kernelLockAcquire();
+	
+	s = diskLock(k);
+	k->k_work = FALSE;
+	diskUnlock(k, s);
+	
+	diskService(k, d);
+}
+
+/**
+  * @brief (Top half) Interrupt di un disco pilotato dalla coda delle richieste: a posizionamento
+  *	   concluso dà il comando di trasferimento, a trasferimento concluso (o fallito) avvia
+  *	   subito la richiesta successiva e accoda la bottom half.
+  * @param d : descrittore del disco.
+  * @return Ritorna TRUE se l'interrupt è stato servito, FALSE se il comando non veniva dalla coda (WAITIO).
+ */
+int diskIntr(device_t *d)
+{
+	disk_t *k = &disks[d->d_dev];
+	dtpreg_t *reg = &d->d_reg->dtp;
+	U32 status;
+	int issued;
+	
+	lockAcquire(&k->k_lock);
+	
+	/* Nessun comando della coda in corso */
+	if((k->k_phase == DISK_IDLE) || (k->k_phase == DISK_WAIT))
+	{
+		lockRelease(&k->k_lock);
+		return FALSE;
+	}
+	
+	status = reg->status;
+	if(((status & CHECK_STATUS_BIT) == DEV_S_READY) && (k->k_phase == DISK_SEEK))
+	{
+		k->k_cyl = k->k_cur->r_cyl;
+		issued = diskXfer(k, reg);
+	}
+	/* Trasferimento concluso, o richiesta fallita */
+	else
+	{
+		if((status & CHECK_STATUS_BIT) == DEV_S_READY) k->k_stats.transfers++;
+		else k->k_stats.errors++;
+		
+		k->k_cur->r_status = status;
+		list_add_tail(&k->k_cur->r_next, &k->k_done);
+		k->k_cur = NULL;
+		issued = diskStart(k, reg);
+	}
+	
+	/* Un nuovo comando riconosce anche l'interrupt */
+	if(!issued) reg->command = DEV_C_ACK;
+	
+	if(!k->k_work && (!list_empty(&k->k_done) || (k->k_phase == DISK_WAIT)))
+	{
+		k->k_work = TRUE;
+		queueWork(diskWork, d, 0);
+	}
+	
+	lockRelease(&k->k_lock);
+	
+	return TRUE;
+}
+
+/**
+  * @brief Controlla i parametri di una DISK_PUT o DISK_GET.
+  * @param buf : blocco (una pagina, allineato a parola).
+  * @param disk : numero del disco.
+  * @param sector : settore (cilindro, testina e settore linearizzati).
+  * @return Ritorna TRUE se il disco è installato e i parametri sono validi, FALSE altrimenti.
+ */
+int diskCheck(char *buf, int disk, U32 sector)
+{
+	disk_t *k;
+	
+	if((disk < 0) || (disk >= DEV_PER_INT) || (buf == NULL) || (((U32) buf) & (WORD_SIZE - 1))) return FALSE;
+	
+	k = &disks[disk];
+	
+	return (devTable[DEV_ROW(INT_DISK, FALSE)][disk].d_reg != NULL) && (sector < k->k_maxCyl * k->k_maxHead * k->k_maxSect);
+}
+
+/**
+  * @brief Accorpa una richiesta all'ultima in coda per lo stesso settore, se è dello stesso tipo,
+  *	   altrimenti la mette in coda. Va chiamata con il lock del disco.
+  * @param k : disco.
+  * @param sector : settore.
+  * @param write : TRUE per una scrittura.
+  * @param b : blocco della cache letto o scritto (una scrittura ne copia i dati quando parte).
+  * @return Ritorna la richiesta su cui attendere.
+ */
+HIDDEN disk_req_t *diskSubmit(disk_t *k, U32 sector, int write, bcache_t *b)
+{
+	disk_req_t *r, *last;
+	
+	last = NULL;
+	list_for_each_entry(r, &k->k_queue, r_next)
+		if(r->r_sector == sector) last = r;
+	
+	if((last != NULL) && (last->r_write == write))
+	{
+		k->k_stats.merged++;
+		return last;
+	}
+	
+	if(list_empty(&k->k_free)) PANIC();
+	
+	r = container_of(k->k_free.next, disk_req_t, r_next);
+	list_del(&r->r_next);
+	
+	r->r_write = write;
+	r->r_sector = sector;
+	r->r_sect = sector % k->k_maxSect;
+	r->r_head = (sector / k->k_maxSect) % k->k_maxHead;
+	r->r_cyl = sector / (k->k_maxSect * k->k_maxHead);
+	r->r_cache = b;
+	mkEmptyProcQ(&r->r_waiters);
+	diskEnqueue(k, r);
+	
+	return r;
+}
+
+/**
+  * @brief Legge dal disco un blocco della cache per il processo corrente, che si blocca: se la
+  *	   lettura riesce ripeterà la SYSCALL, e copierà il blocco dalla cache nel proprio
+  *	   contesto; altrimenti riceve lo status negato. Va chiamata con kernelLock.
+  * @param b : blocco della cache (b_disk e b_sector validi).
+  * @return void.
+ */
+void diskRead(bcache_t *b)
+{
+	device_t *d = &devTable[DEV_ROW(INT_DISK, FALSE)][b->b_disk];
+	disk_t *k = &disks[b->b_disk];
+	disk_req_t *r;
+	U32 s;
+	
+	/* Gli interrupt del disco arrivano alla CPU su cui il processo si blocca */
+	irtRouteHere(INT_DISK, b->b_disk);
+	
+	s = diskLock(k);
+	k->k_stats.requests++;
+	r = diskSubmit(k, b->b_sector, FALSE, b);
+	
+	currentProcess->p_ioRestart = TRUE;
+	currentProcess->p_ioDev = b->b_disk;
+	insertProcQ(&r->r_waiters, currentProcess);
+	currentProcess->p_isOnDev = IS_ON_DISK;
+	currentProcess = NULL;
+	atomicAdd(&softBlockCount, 1);
+	
+	if(k->k_phase == DISK_IDLE) diskStart(k, &d->d_reg->dtp);
+	diskUnlock(k, s);
+	
+	/* Prepara la pagina DMA per la richiesta appena avviata */
+	diskService(k, d);
+	
+	scheduler();
+}
+
+/**
+  * @brief Scrive sul disco un blocco della cache, senza processi in attesa: al completamento
+  *	   viene chiamata bcacheDone. Va chiamata con kernelLock.
+  * @param b : blocco della cache (b_disk e b_sector validi).
+  * @return void.
+ */
+void diskWriteBack(bcache_t *b)
+{
+	device_t *d = &devTable[DEV_ROW(INT_DISK, FALSE)][b->b_disk];
+	disk_t *k = &disks[b->b_disk];
+	U32 s;
+	
+	s = diskLock(k);
+	k->k_stats.requests++;
+	diskSubmit(k, b->b_sector, TRUE, b);
+	if(k->k_phase == DISK_IDLE) diskStart(k, &d->d_reg->dtp);
+	diskUnlock(k, s);
+	
+	diskService(k, d);
+}
+
+/**
+  * @brief Toglie un processo terminato dall'attesa di un blocco della cache o dalla lettura che
+  *	   attendeva: la lettura si conclude comunque, e riempie il blocco della cache.
+  * @param p : processo bloccato con IS_ON_DISK.
+  * @return void.
+ */
+void diskCancel(pcb_t *p)
+{
+	disk_t *k = &disks[p->p_ioDev];
+	disk_req_t *r;
+	U32 s;
+	
+	if(bcacheCancel(p)) return;
+	
+	s = diskLock(k);
+	
+	list_for_each_entry(r, &k->k_queue, r_next)
+		outProcQ(&r->r_waiters, p);
+	if(k->k_cur != NULL) outProcQ(&k->k_cur->r_waiters, p);
+	list_for_each_entry(r, &k->k_done, r_next)
+		outProcQ(&r->r_waiters, p);
+	
+	diskUnlock(k, s);
+}
+
+/**
+  * @brief (SYS30) Copia le statistiche di un disco, compresa la sua parte della cache dei blocchi.
+  * @param disk : numero del disco.
+  * @param stats : struttura che riceve le statistiche.
+  * @return Ritorna 0, -1 se i parametri non sono validi.
+ */
+int getDiskStats(int disk, disk_stats_t *stats)
+{
+	disk_t *k;
+	U32 s;
+	
+	if((disk < 0) || (disk >= DEV_PER_INT) || (stats == NULL)) return -1;
+	
+	k = &disks[disk];
+	
+	s = diskLock(k);
+	stats->requests = k->k_stats.requests;
+	stats->merged = k->k_stats.merged;
+	stats->transfers = k->k_stats.transfers;
+	stats->errors = k->k_stats.errors;
+	stats->seeks = k->k_stats.seeks;
+	stats->seek_dist = k->k_stats.seek_dist;
+	stats->busy_time = k->k_stats.busy_time;
+	if(k->k_phase != DISK_IDLE) stats->busy_time += kernelNow - k->k_busySince;
+	diskUnlock(k, s);
+	
+	bcacheStats(disk, stats);
+	
+	return 0;
+}
+
+/**
+  * @brief Inizializza le code delle richieste, leggendo la geometria dei dischi installati
+  *	   (dopo intDevicesInit).
+  * @return void.
+ */
+void diskInit()
+{
+	device_t *d;
+	disk_t *k;
+	int i, j;
+	
+	for(i=0; i<DEV_PER_INT; i++)
+	{
+		k = &disks[i];
+		d = &devTable[DEV_ROW(INT_DISK, FALSE)][i];
+		
+		lockInit(&k->k_lock, LOCK_RANK_DISK);
+		INIT_LIST_HEAD(&k->k_queue);
+		INIT_LIST_HEAD(&k->k_free);
+		INIT_LIST_HEAD(&k->k_done);
+		for(j=0; j<DISK_REQS; j++) list_add_tail(&diskReqs[i][j].r_next, &k->k_free);
+		
+		k->k_cur = NULL;
+		k->k_phase = DISK_IDLE;
+		k->k_ready = k->k_work = FALSE;
+		k->k_cyl = k->k_last = 0;
+		
+		k->k_maxCyl = (d->d_reg != NULL) ? DISK_MAX_CYL(d->d_reg->dtp.data1) : 0;
+		k->k_maxHead = (d->d_reg != NULL) ? DISK_MAX_HEAD(d->d_reg->dtp.data1) : 0;
+		k->k_maxSect = (d->d_reg != NULL) ? DISK_MAX_SECT(d->d_reg->dtp.data1) : 0;
+		
+		k->k_stats.requests = k->k_stats.merged = k->k_stats.transfers = k->k_stats.errors = 0;
+		k->k_stats.seeks = k->k_stats.seek_dist = 0;
+		k->k_stats.busy_time = 0;
+	}
+}
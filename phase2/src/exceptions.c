@@ -9,18 +9,44 @@
 #include <pcb.e>
 
 /* Inclusioni phase2 */
+#include <bcache.e>
+#include <clock.e>
+#include <cpu.e>
+#include <disk.e>
 #include <exceptions.e>
 #include <initial.e>
 #include <interrupts.e>
+#include <ktimer.e>
+#include <latency.e>
+#include <lock.e>
 #include <scheduler.e>
+#include <terminal.e>
 
 /* Inclusioni uMPS */
 #include <libumps.e>
 
-/* Old Area delle Syscall/BP - TLB - Program Trap */
-HIDDEN state_t *sysBp_old = (state_t *) SYSBK_OLDAREA;
-HIDDEN state_t *TLB_old = (state_t *) TLB_OLDAREA;
-HIDDEN state_t *pgmTrap_old = (state_t *) PGMTRAP_OLDAREA;
+/* Old Area delle Syscall/BP - TLB - Program Trap (della CPU corrente) */
+#define sysBp_old (thisCpu->c_sysBpOld)
+#define TLB_old (thisCpu->c_tlbOld)
+#define pgmTrap_old (thisCpu->c_pgmTrapOld)
+
+/* Tabella dei semafori registrati come mutex (MUTEXINIT) */
+HIDDEN mutex_t mutexTable[MAXMUTEX];
+
+/**
+  * @brief Ultimi eventi di ereditarietà della priorità (buffer circolare, per il debug)
+ */
+pi_trace_t piTrace[PI_TRACE_SIZE];
+
+/**
+  * @brief Numero totale di eventi di ereditarietà (la prossima cella di piTrace è piTraceCount % PI_TRACE_SIZE)
+ */
+U32 piTraceCount;
+
+/**
+  * @brief Numero di catene di blocco troncate a PI_MAX_DEPTH
+ */
+U32 piChainTruncated;
 
 /**
   * @brief Salva lo stato corrente (current) in un nuovo stato passato per parametro (new)
@@ -44,12 +70,19 @@ void saveCurrentState (state_t *current, state_t *new)
 }
 
 /**
-  * @brief Esegue una 'P' sul semaforo passato per parametro. E' diversa dalla SYS4 siccome viene incrementato il softBlockCount.
-  * @param *semaddr : puntatore al semaforo su cui fare la 'P'
-  * @return void.
+  * @brief Esegue una 'P' sul semaforo del device passato per parametro. E' diversa dalla SYS4 siccome viene incrementato il softBlockCount.
+  *	   Se il processo si blocca, lo status gli verrà consegnato dal gestore degli interrupt.
+  * @param d : descrittore del device su cui fare la 'P'
+  * @return Restituisce lo status del completamento più vecchio non ancora ritirato, se il processo non si blocca.
  */
-HIDDEN void passerenIO(int *semaddr)
+HIDDEN U32 passerenIO(device_t *d)
 {
+	int *semaddr = d->d_sem;
+	U32 status;
+	
+	/* I semafori dei device sono aggiornati anche dagli interrupt, senza kernelLock */
+	lockAcquire(&devSemLock);
+	
 	(*semaddr)--;
 
 	if((*semaddr) < 0)
@@ -58,9 +91,133 @@ HIDDEN void passerenIO(int *semaddr)
 		if(insertBlocked((S32 *) semaddr, currentProcess)) PANIC(); /* PANIC se sono finiti i descrittori dei semafori */
 		currentProcess->p_isOnDev = IS_ON_DEV;
 		currentProcess = NULL;
-		softBlockCount++;
+		atomicAdd(&softBlockCount, 1);
+		lockRelease(&devSemLock);
 		scheduler();
 	}
+	
+	/* Il completamento è già avvenuto */
+	status = devRingGet(d);
+	
+	lockRelease(&devSemLock);
+	
+	return status;
+}
+
+/**
+  * @brief Inizializza la tabella dei mutex.
+  * @return void.
+ */
+void initMutexes()
+{
+	int i;
+	
+	for(i=0; i<MAXMUTEX; i++)
+	{
+		mutexTable[i].m_semAdd = NULL;
+		mutexTable[i].m_owner = NULL;
+	}
+	
+	piTraceCount = piChainTruncated = 0;
+}
+
+/**
+  * @brief Cerca il mutex associato a un semaforo.
+  * @param semaddr : indirizzo del semaforo.
+  * @return Ritorna il mutex, NULL se il semaforo non è registrato come mutex.
+ */
+HIDDEN mutex_t *findMutex(int *semaddr)
+{
+	int i;
+	
+	if(semaddr == NULL) return NULL;
+	
+	for(i=0; i<MAXMUTEX; i++)
+		if(mutexTable[i].m_semAdd == semaddr) return &mutexTable[i];
+	
+	return NULL;
+}
+
+/**
+  * @brief Calcola la priorità effettiva di un processo: la massima tra la sua priorità base e quella
+  *	   dei processi bloccati sui mutex che detiene.
+  * @param p : pcb del processo.
+  * @return Ritorna la priorità effettiva.
+ */
+HIDDEN int inheritedPriority(pcb_t *p)
+{
+	int i, prio;
+	
+	prio = p->p_prio;
+	
+	for(i=0; i<MAXMUTEX; i++)
+		if(mutexTable[i].m_owner == p)
+			prio = blockedMaxPrio((S32 *) mutexTable[i].m_semAdd, prio);
+	
+	return prio;
+}
+
+/**
+  * @brief Ricalcola la priorità effettiva di un processo (es. dopo il rilascio di un mutex).
+  * @param p : pcb del processo (può essere NULL).
+  * @return void.
+ */
+HIDDEN void restorePriority(pcb_t *p)
+{
+	if(p != NULL) setEffPriority(p, inheritedPriority(p));
+}
+
+/**
+  * @brief Cede la priorità di un processo che si blocca su un mutex al detentore, seguendo la catena
+  *	   dei detentori a loro volta bloccati su altri mutex per al più PI_MAX_DEPTH passi.
+  * @param m : mutex su cui il processo si è bloccato.
+  * @param waiter : processo bloccato.
+  * @return void.
+ */
+HIDDEN void piBoost(mutex_t *m, pcb_t *waiter)
+{
+	pcb_t *owner;
+	pi_trace_t *t;
+	int depth;
+	
+	for(owner = m->m_owner, depth = 0; (owner != NULL) && (owner->p_effprio < waiter->p_effprio); depth++)
+	{
+		if(depth == PI_MAX_DEPTH)
+		{
+			piChainTruncated++;
+			break;
+		}
+		
+		/* Traccia dell'evento */
+		t = &piTrace[piTraceCount % PI_TRACE_SIZE];
+		t->pi_owner = owner->p_pid;
+		t->pi_waiter = waiter->p_pid;
+		t->pi_from = owner->p_effprio;
+		t->pi_to = waiter->p_effprio;
+		t->pi_depth = depth;
+		piTraceCount++;
+		
+		owner->p_boosts++;
+		setEffPriority(owner, waiter->p_effprio);
+		
+		/* Se il detentore è a sua volta bloccato su un mutex, la priorità passa al detentore di quest'ultimo */
+		if((owner->p_isOnDev != IS_ON_SEM) || ((m = findMutex((int *) owner->p_semAdd)) == NULL))
+			break;
+		owner = m->m_owner;
+	}
+}
+
+/**
+  * @brief Rilascia i mutex detenuti da un processo che sta terminando.
+  * @param p : pcb del processo.
+  * @return void.
+ */
+HIDDEN void mutexRelease(pcb_t *p)
+{
+	int i;
+	
+	for(i=0; i<MAXMUTEX; i++)
+		if(mutexTable[i].m_owner == p) mutexTable[i].m_owner = NULL;
 }
 
 /**
@@ -72,6 +229,13 @@ void sysBpHandler()
 	int cause_excCode;
 	int kuMode;
 	
+	/* Contabilizza l'ingresso nel nucleo e prende kernelLock */
+	kernelEntry();
+	kernelLockAcquire();
+	
+	/* Il processo è stato terminato da un'altra CPU mentre era in esecuzione: il suo stato va scartato */
+	if(reapKilled()) scheduler();
+	
 	/* Salva lo stato della vecchia area SysBp */
 	saveCurrentState(sysBp_old, &(currentProcess->p_state));
 	
@@ -90,8 +254,8 @@ void sysBpHandler()
 		/* Controlla se è in USER MODE */
 		if(kuMode == TRUE)
 		{
-			/* Se è stata chiamata una delle 13 Syscall */
-			if((sysBp_old->reg_a0 > 0) && (sysBp_old->reg_a0 < RANGE_SYSCALL))
+			/* Se è stata chiamata una delle Syscall del nucleo */
+			if(IS_NUCLEUS_SYSCALL(sysBp_old->reg_a0))
 			{
 				/* Imposta Cause.ExcCode a RI */
 				sysBp_old->cause = CAUSE_EXCCODE_SET(sysBp_old->cause, EXC_RESERVEDINSTR);
@@ -115,6 +279,7 @@ void sysBpHandler()
 				else
 				{
 					saveCurrentState(sysBp_old, currentProcess->sysbpState_old);
+					kernelExit();
 					LDST(currentProcess->sysbpState_new);
 				}
 			}
@@ -154,7 +319,7 @@ void sysBpHandler()
 				break;
 				
 				case GETCPUTIME:
-					currentProcess->p_state.reg_v0 = getCPUTime();
+					currentProcess->p_state.reg_v0 = getCPUTime((int) arg1);
 				break;
 				
 				case WAITCLOCK:
@@ -181,6 +346,66 @@ void sysBpHandler()
 					specSYSvect((state_t *) arg1, (state_t *)arg2);
 				break;
 				
+				case SETQUANTUM:
+					currentProcess->p_state.reg_v0 = setQuantum((cpu_t) arg1, (int) arg2);
+				break;
+				
+				case GETSCHEDSTATS:
+					currentProcess->p_state.reg_v0 = getSchedStats((int) arg1, (sched_stats_t *) arg2);
+				break;
+				
+				case SETQUOTA:
+					currentProcess->p_state.reg_v0 = setQuota((int) arg1, (cpu_t) arg2, (cpu_t) arg3);
+				break;
+				
+				case SETPRIORITY:
+					currentProcess->p_state.reg_v0 = setPriority((int) arg1, (int) arg2);
+				break;
+				
+				case MUTEXINIT:
+					currentProcess->p_state.reg_v0 = mutexInit((int *) arg1, (int) arg2);
+				break;
+				
+				case READTERMINAL:
+					currentProcess->p_state.reg_v0 = readTerminal((char *) arg1, (int) arg2, (int) arg3);
+				break;
+				
+				case WRITETERMINAL:
+					currentProcess->p_state.reg_v0 = writeTerminal((char *) arg1, (int) arg2, (int) arg3);
+				break;
+				
+				case DISK_PUT:
+					currentProcess->p_state.reg_v0 = bcachePut((char *) arg1, (int) arg2, (U32) arg3);
+				break;
+				
+				case DISK_GET:
+					currentProcess->p_state.reg_v0 = bcacheGet((char *) arg1, (int) arg2, (U32) arg3);
+				break;
+				
+				case DELAY:
+					delay((U32) arg1);
+				break;
+				
+				case SETAFFINITY:
+					currentProcess->p_state.reg_v0 = setAffinity((int) arg1, (U32) arg2);
+				break;
+				
+				case SETSLACK:
+					currentProcess->p_state.reg_v0 = setSlack((int) arg1, (U32) arg2);
+				break;
+				
+				case GETLATENCY:
+					currentProcess->p_state.reg_v0 = getLatency((int) arg1, (int) arg2, (lat_hist_t *) arg3);
+				break;
+				
+				case GETDISKSTATS:
+					currentProcess->p_state.reg_v0 = getDiskStats((int) arg1, (disk_stats_t *) arg2);
+				break;
+				
+				case GETSYSSTATS:
+					currentProcess->p_state.reg_v0 = getSysStats((sys_stats_t *) arg1);
+				break;
+				
 				default:
 					/* Se non è già stata eseguita la SYS12, viene terminato il processo corrente */
 					if(currentProcess->ExStVec[ESV_SYSBP] == 0) 
@@ -194,6 +419,7 @@ void sysBpHandler()
 					else
 					{
 						saveCurrentState(sysBp_old, currentProcess->sysbpState_old);
+						kernelExit();
 						LDST(currentProcess->sysbpState_new);
 					}
 			}
@@ -217,6 +443,7 @@ void sysBpHandler()
 		else
 		{
 			saveCurrentState(sysBp_old, currentProcess->sysbpState_old);
+			kernelExit();
 			LDST(currentProcess->sysbpState_new);
 		}
 	}
@@ -254,10 +481,25 @@ int createProcess(state_t *statep)
 		pcbused_table[i].pid = p->p_pid;
 		pcbused_table[i].pcb = p;
 		
-		/* p diventa un nuovo figlio del processo chiamante */
+		/* p diventa un nuovo figlio del processo chiamante ed eredita il suo quanto */
 		insertChild(currentProcess, p);
+		p->p_quantum = currentProcess->p_quantum;
+		p->p_adaptive = currentProcess->p_adaptive;
+		
+		/* Il figlio eredita la priorità base del padre */
+		p->p_prio = p->p_effprio = currentProcess->p_prio;
+		
+		/* Il figlio eredita l'affinità e lo slack dei timer del padre */
+		p->p_affinity = currentProcess->p_affinity;
+		p->p_slack = currentProcess->p_slack;
+		
+		/* Il figlio appartiene al gruppo di quota del padre */
+		if((p->p_group = currentProcess->p_group) != NULL)
+			p->p_group->q_members++;
 
-		insertProcQ(&readyQueue, p);
+		/* Il figlio viene accodato sulla CPU del padre, se permessa (le CPU inattive lo possono rubare) */
+		p->p_cpu = CPU_ID;
+		insertReady(p);
 		
 		return pidCount;
 	}
@@ -302,15 +544,57 @@ int terminateProcess(int pid)
 	/* Se il processo è bloccato su un semaforo esterno, incrementa questo ultimo */
 	if(pToKill->p_isOnDev == IS_ON_SEM)
 	{
+		mutex_t *m;
+		
 		/* Caso Anomalo */
 		if(pToKill->p_semAdd == NULL) PANIC();
 		
+		m = findMutex((int *) pToKill->p_semAdd);
+		
 		/* Incrementa il semaforo e aggiorna questo ultimo se vuoto */
 		(*pToKill->p_semAdd)++;
 		pToKill = outBlocked(pToKill);
+		
+		/* Il detentore del mutex non eredita più la priorità del processo ucciso */
+		if(m != NULL) restorePriority(m->m_owner);
 	}
 	/* Se invece è bloccato sul semaforo dello pseudo-clock, si incrementa questo ultimo */
 	else if(pToKill->p_isOnDev == IS_ON_PSEUDO) pseudo_clock++;
+	/* Se sta dormendo (DELAY), il suo timer viene tolto dalla timer wheel */
+	else if(pToKill->p_isOnDev == IS_SLEEPING)
+	{
+		ktimerCancel(&pToKill->p_sleep);
+		atomicAdd(&softBlockCount, -1);
+	}
+	/* Se attende una riga o la fine di una scrittura, viene tolto dalle code del terminale */
+	else if(pToKill->p_isOnDev == IS_ON_TERM)
+	{
+		termCancel(pToKill);
+		atomicAdd(&softBlockCount, -1);
+	}
+	/* Se attende una richiesta a un disco, viene tolto dai processi che la attendono */
+	else if(pToKill->p_isOnDev == IS_ON_DISK)
+	{
+		diskCancel(pToKill);
+		atomicAdd(&softBlockCount, -1);
+	}
+	/* Se è pronto, viene tolto dalla Ready Queue (se strozzato, lo toglie quotaLeave).
+	   Se è in esecuzione su un'altra CPU, sarà quella CPU a liberarne il pcb (reapKilled) */
+	else if(pToKill->p_isOnDev == FALSE)
+	{
+		/* Se è stato svegliato per ripetere una WRITETERMINAL, può avere il turno di un terminale */
+		termCancel(pToKill);
+		
+		if((outReady(pToKill) == NULL) && (pToKill != currentProcess))
+		{
+			pToKill->p_killed = TRUE;
+			cpuKick(pToKill->p_cpu);
+		}
+	}
+	
+	/* Esce dal suo gruppo di quota e rilascia i mutex che deteneva */
+	quotaLeave(pToKill);
+	mutexRelease(pToKill);
 	
 	/* Se il processo da uccidere ha dei figli, li uccide ricorsivamente */
 	while(emptyChild(pToKill) == FALSE)
@@ -328,10 +612,13 @@ int terminateProcess(int pid)
 		pcbused_table[i].pid = 0;
 		pcbused_table[i].pcb = NULL;
 		
-		freePcb(pToKill);
+		if(!pToKill->p_killed) freePcb(pToKill);
 	}
 	
 	if(isSuicide == TRUE) currentProcess = NULL;
+	
+	/* Il tempo di nucleo non va addebitato a un pcb ormai libero */
+	if(kernelProcess == pToKill) kernelProcess = NULL;
 
 	processCount--;
 
@@ -346,16 +633,30 @@ int terminateProcess(int pid)
 void verhogen(int *semaddr)
 {
 	pcb_t *p;
+	pcb_t *owner;
+	mutex_t *m;
+	
+	m = findMutex(semaddr);
 	
 	(*semaddr)++;
 	
 	p = removeBlocked((S32 *) semaddr);
+	
+	/* Se è un mutex, la proprietà passa al processo sbloccato (che eredita dai bloccati rimasti)
+	   e il vecchio detentore torna alla sua priorità */
+	if(m != NULL)
+	{
+		owner = m->m_owner;
+		m->m_owner = p;
+		if(p != NULL) p->p_effprio = inheritedPriority(p);
+		restorePriority(owner);
+	}
+	
 	/* Se è stato sbloccato un processo da un semaforo esterno */
 	if (p != NULL)
 	{
-		/* Viene inserito nella readyQueue e viene aggiornata la flag isOnDev a FALSE */
-		insertProcQ(&readyQueue, p);
-		p->p_isOnDev = FALSE;
+		/* Viene inserito nella readyQueue (che aggiorna la flag isOnDev) */
+		insertReady(p);
 	}
 }
 
@@ -366,6 +667,10 @@ void verhogen(int *semaddr)
  */
 void passeren(int *semaddr)
 {
+	mutex_t *m;
+	
+	m = findMutex(semaddr);
+	
 	(*semaddr)--;
 	
 	/* Se un processo viene sospeso ... */
@@ -374,8 +679,14 @@ void passeren(int *semaddr)
 		/* Inserisce il processo corrente in coda al semaforo specificato */
 		if(insertBlocked((S32 *) semaddr, currentProcess)) PANIC();
 		currentProcess->p_isOnDev = IS_ON_SEM;
+		
+		/* Se è un mutex, il detentore eredita la priorità del processo bloccato */
+		if(m != NULL) piBoost(m, currentProcess);
+		
 		currentProcess = NULL;
 	}
+	/* Altrimenti, se è un mutex, il processo ne diventa il detentore */
+	else if(m != NULL) m->m_owner = currentProcess;
 }
 
 /**
@@ -389,15 +700,25 @@ int getPid()
 
 /**
   * @brief (SYS6) Restituisce il tempo d'uso della CPU da parte del processo chiamante.
-  * @return Restituisce il tempo d'uso della CPU.
+  * @param which : contatore richiesto (CPUT_TOTAL, CPUT_USER, CPUT_SYS, CPUT_WAIT, CPUT_SLICE).
+  * @return Restituisce il tempo d'uso della CPU (cumulativo per CPUT_TOTAL).
  */
-cpu_t getCPUTime()
+cpu_t getCPUTime(int which)
 {
-	/* Aggiorna il tempo di vita del processo sulla CPU */
-	currentProcess->p_cpu_time += (GET_TODLOW - processTOD);
-	processTOD = GET_TODLOW;
-	
-	return currentProcess->p_cpu_time;
+	/* Il tempo di nucleo di questa SYSCALL viene addebitato all'uscita (kernelExit) */
+	switch(which)
+	{
+		case CPUT_USER:
+			return currentProcess->p_cpu_time - currentProcess->p_sys_time;
+		case CPUT_SYS:
+			return currentProcess->p_sys_time;
+		case CPUT_WAIT:
+			return currentProcess->p_wait_time;
+		case CPUT_SLICE:
+			return currentProcess->p_slice_time;
+		default:
+			return currentProcess->p_cpu_time;
+	}
 }
 
 /**
@@ -414,45 +735,66 @@ void waitClock()
 		if(insertBlocked((S32 *) &pseudo_clock, currentProcess)) PANIC(); /* PANIC se sono finiti i descrittori dei semafori */
 		currentProcess->p_isOnDev = IS_ON_PSEUDO;
 		currentProcess = NULL;
-		softBlockCount++;
+		atomicAdd(&softBlockCount, 1);
 		scheduler();
 	}
 	
 }
 
+/**
+  * @brief Risveglia un processo la cui DELAY è scaduta.
+  * @param k : timer scaduto (p_sleep del processo).
+  * @return void.
+ */
+HIDDEN void sleepExpired(ktimer_t *k)
+{
+	pcb_t *p = container_of(k, pcb_t, p_sleep);
+	
+	atomicAdd(&softBlockCount, -1);
+	insertReady(p);
+}
+
+/**
+  * @brief (SYS17) Sospende il processo chiamante per almeno il tempo indicato, tramite un timer
+  *	   del nucleo che può scadere fino a p_slack microsecondi dopo.
+  * @param us : microsecondi di attesa (0 non sospende).
+  * @return void.
+ */
+void delay(U32 us)
+{
+	if(us == 0) return;
+	
+	ktimerInit(&currentProcess->p_sleep, sleepExpired);
+	ktimerArmSlack(&currentProcess->p_sleep, kernelNow + us, currentProcess->p_slack);
+	currentProcess->p_isOnDev = IS_SLEEPING;
+	currentProcess = NULL;
+	atomicAdd(&softBlockCount, 1);
+	
+	scheduler();
+}
+
 /**
   * @brief (SYS8) Effettua una P sul semaforo del device specificato.
   * @param intlNo : ennesima linea di interrupt.
   * @param dnum : numero del device.
   * @param waitForTermRead : TRUE se aspetta una lettura da terminale. FALSE altrimenti.
-  * @return Restituisce lo Status Word del device specificato.
+  * @return Restituisce lo Status Word del completamento più vecchio non ancora ritirato (DEV_S_NOTINSTALLED se il device non è installato).
  */
 unsigned int waitIO(int intlNo, int dnum, int waitForTermRead)
 {
-	switch(intlNo)
-	{
-		case INT_DISK:
-			passerenIO(&sem.disk[dnum]);
-		break;
-		case INT_TAPE:
-			passerenIO(&sem.tape[dnum]);
-		break;
-		case INT_UNUSED:
-			passerenIO(&sem.network[dnum]);
-		break;
-		case INT_PRINTER:
-			passerenIO(&sem.printer[dnum]);
-		break;
-		case INT_TERMINAL:
-			if(waitForTermRead)
-				passerenIO(&sem.terminalR[dnum]);
-			else
-				passerenIO(&sem.terminalT[dnum]);
-		break;
-		default: PANIC();
-	}
+	device_t *d;
+	
+	if((intlNo < INT_LOWEST) || (intlNo > INT_TERMINAL) || (dnum < 0) || (dnum >= DEV_PER_INT)) PANIC();
 	
-	return statusWordDev[intlNo - DEV_DIFF + waitForTermRead][dnum];
+	d = &devTable[DEV_ROW(intlNo, waitForTermRead)][dnum];
+	
+	/* Su un device non installato non arriverà mai un interrupt */
+	if(d->d_reg == NULL) return DEV_S_NOTINSTALLED;
+	
+	/* Il completamento sarà segnalato alla CPU su cui il processo attende */
+	irtRouteHere(intlNo, dnum);
+	
+	return passerenIO(d);
 }
 
 /**
@@ -551,9 +893,15 @@ void tlbHandler()
 {
 	int ris;
 	
-	/* Se un processo è attualmente eseguito dal processore, la TLB Old Area viene caricata sul processo corrente */
-	if(currentProcess != NULL)
-		saveCurrentState(TLB_old, &(currentProcess->p_state));
+	/* Contabilizza l'ingresso nel nucleo e prende kernelLock */
+	kernelEntry();
+	kernelLockAcquire();
+	
+	/* Il processo è stato terminato da un'altra CPU mentre era in esecuzione: il suo stato va scartato */
+	if(reapKilled()) scheduler();
+	
+	/* La TLB Old Area viene caricata sul processo corrente */
+	saveCurrentState(TLB_old, &(currentProcess->p_state));
 		
 	/* Se non è già stata eseguita la SYS10, viene terminato il processo corrente */
 	if(currentProcess->ExStVec[ESV_TLB] == 0) 
@@ -566,6 +914,7 @@ void tlbHandler()
 	else
 	{
 		saveCurrentState(TLB_old, currentProcess->tlbState_old);
+		kernelExit();
 		LDST(currentProcess->tlbState_new);
 	}
 }
@@ -578,11 +927,15 @@ void pgmTrapHandler()
 {
 	int ris;
 	
-	/* Se un processo è attualmente eseguito dal processore, la pgmTrap Old Area viene caricata sul processo corrente */
-	if(currentProcess != NULL)
-	{
-		saveCurrentState(pgmTrap_old, &(currentProcess->p_state));
-	}
+	/* Contabilizza l'ingresso nel nucleo e prende kernelLock (ignorati se già dentro, come per le SYS riservate in User Mode) */
+	kernelEntry();
+	kernelLockAcquire();
+	
+	/* Il processo è stato terminato da un'altra CPU mentre era in esecuzione: il suo stato va scartato */
+	if(reapKilled()) scheduler();
+	
+	/* La pgmTrap Old Area viene caricata sul processo corrente */
+	saveCurrentState(pgmTrap_old, &(currentProcess->p_state));
 	
 	/* Se non è già stata eseguita la SYS11, viene terminato il processo corrente */
 	if(currentProcess->ExStVec[ESV_PGMTRAP] == 0)
@@ -595,6 +948,228 @@ void pgmTrapHandler()
 	else
 	{
 		saveCurrentState(pgmTrap_old, currentProcess->pgmtrapState_old);
+		kernelExit();
 		LDST(currentProcess->pgmtrapState_new);
 	}
 }
+
+/**
+  * @brief Cerca un processo attivo nella tabella dei pcb utilizzati.
+  * @param pid : identificativo del processo (-1 per il processo chiamante).
+  * @return Ritorna il pcb del processo, NULL se non esiste.
+ */
+HIDDEN pcb_t *findPcb(int pid)
+{
+	int i;
+	
+	if(pid == -1) return currentProcess;
+	
+	for(i=0; i<MAXPROC; i++)
+		if(pcbused_table[i].pid == pid) return pcbused_table[i].pcb;
+	
+	return NULL;
+}
+
+/**
+  * @brief (SYS22) Imposta il quanto di tempo del processo chiamante.
+  * @param quantum : nuovo quanto in microsecondi (0 per lasciarlo invariato), limitato a [SCHED_QUANTUM_MIN, SCHED_QUANTUM_MAX].
+  * @param adaptive : TRUE se il quanto deve adattarsi automaticamente al comportamento del processo.
+  * @return Restituisce il quanto precedente.
+ */
+cpu_t setQuantum(cpu_t quantum, int adaptive)
+{
+	cpu_t old = currentProcess->p_quantum;
+	
+	if(quantum != 0)
+	{
+		if(quantum < SCHED_QUANTUM_MIN) quantum = SCHED_QUANTUM_MIN;
+		if(quantum > SCHED_QUANTUM_MAX) quantum = SCHED_QUANTUM_MAX;
+		currentProcess->p_quantum = quantum;
+	}
+	
+	currentProcess->p_adaptive = adaptive ? TRUE : FALSE;
+	
+	return old;
+}
+
+/**
+  * @brief (SYS23) Copia le statistiche dello scheduler di un processo.
+  * @param pid : identificativo del processo (-1 per il processo chiamante).
+  * @param stats : struttura in cui copiare le statistiche.
+  * @return Restituisce 0 in caso di successo, -1 se il processo non esiste.
+ */
+int getSchedStats(int pid, sched_stats_t *stats)
+{
+	pcb_t *p;
+	
+	if((p = findPcb(pid)) == NULL) return -1;
+	
+	stats->pid = p->p_pid;
+	stats->cpu_time = p->p_cpu_time;
+	stats->user_time = p->p_cpu_time - p->p_sys_time;
+	stats->sys_time = p->p_sys_time;
+	stats->wait_time = p->p_wait_time;
+	stats->quantum = p->p_quantum;
+	stats->adaptive = p->p_adaptive;
+	stats->dispatches = p->p_dispatches;
+	stats->preemptions = p->p_preemptions;
+	stats->blocks = p->p_blocks;
+	stats->prio = p->p_prio;
+	stats->effprio = p->p_effprio;
+	stats->boosts = p->p_boosts;
+	
+	return 0;
+}
+
+/**
+  * @brief (SYS31) Copia le statistiche del sistema.
+  * @param stats : struttura in cui copiare le statistiche.
+  * @return Restituisce 0 in caso di successo, -1 se stats non è valido.
+ */
+int getSysStats(sys_stats_t *stats)
+{
+	if(stats == NULL) return -1;
+	
+	stats->load_avg = loadAvg;
+	stats->timer_coalesced = ktimerCoalesced;
+	stats->timer_irq_saved = ktimerIrqSaved;
+	stats->term_irq_saved = termIrqSaved;
+	stats->int_top_half_max = intTopHalfMax;
+	stats->int_handler_max = intHandlerMax;
+	stats->int_masked_max = intMaskedMax;
+	stats->dev_ring_lost = devRingLost();
+	
+	return 0;
+}
+
+/**
+  * @brief (SYS24) Limita la CPU usata dal sottoalbero di processi radicato in pid.
+  * @param pid : radice del sottoalbero (-1 per il processo chiamante).
+  * @param budget : CPU concessa per periodo, in microsecondi (0 scioglie il gruppo del processo).
+  * @param period : lunghezza del periodo, in microsecondi.
+  * @return Restituisce l'indice del gruppo di quota, -1 in caso di errore.
+ */
+int setQuota(int pid, cpu_t budget, cpu_t period)
+{
+	pcb_t *p;
+	
+	if((p = findPcb(pid)) == NULL) return -1;
+	
+	return quotaAssign(p, budget, period);
+}
+
+/**
+  * @brief (SYS25) Imposta la priorità base di un processo.
+  * @param pid : identificativo del processo (-1 per il processo chiamante).
+  * @param prio : nuova priorità base, limitata a [PRIO_MIN, PRIO_MAX].
+  * @return Restituisce la priorità base precedente, -1 se il processo non esiste.
+ */
+int setPriority(int pid, int prio)
+{
+	pcb_t *p;
+	int old;
+	
+	if((p = findPcb(pid)) == NULL) return -1;
+	
+	if(prio < PRIO_MIN) prio = PRIO_MIN;
+	if(prio > PRIO_MAX) prio = PRIO_MAX;
+	
+	old = p->p_prio;
+	p->p_prio = prio;
+	
+	/* La priorità effettiva non scende sotto quella ereditata dai mutex detenuti */
+	restorePriority(p);
+	
+	return old;
+}
+
+/**
+  * @brief (SYS26) Inizializza un semaforo come mutex (valore 1) con ereditarietà della priorità,
+  *	   oppure lo rimuove dalla tabella dei mutex.
+  * @param semaddr : indirizzo del semaforo.
+  * @param enable : TRUE per registrarlo come mutex, FALSE per rimuoverlo.
+  * @return Restituisce 0 in caso di successo, -1 se la tabella dei mutex è piena o il semaforo ha processi bloccati.
+ */
+int mutexInit(int *semaddr, int enable)
+{
+	mutex_t *m;
+	pcb_t *owner;
+	int i;
+	
+	m = findMutex(semaddr);
+	
+	if(!enable)
+	{
+		if(m != NULL)
+		{
+			owner = m->m_owner;
+			m->m_semAdd = NULL;
+			m->m_owner = NULL;
+			restorePriority(owner);
+		}
+		return 0;
+	}
+	
+	/* Un semaforo con processi bloccati non può essere reinizializzato */
+	if(headBlocked((S32 *) semaddr) != NULL) return -1;
+	
+	if(m == NULL)
+	{
+		for(i=0; i<MAXMUTEX; i++)
+			if(mutexTable[i].m_semAdd == NULL) break;
+		
+		if(i == MAXMUTEX) return -1;
+		m = &mutexTable[i];
+	}
+	
+	m->m_semAdd = semaddr;
+	m->m_owner = NULL;
+	*semaddr = 1;
+	
+	return 0;
+}
+
+/**
+  * @brief (SYS27) Imposta l'insieme delle CPU su cui un processo può essere eseguito.
+  * @param pid : identificativo del processo (-1 per il processo chiamante).
+  * @param mask : maschera di affinità (bit i = CPU i); le CPU non esistenti vengono ignorate.
+  * @return Restituisce la maschera precedente, -1 se il processo non esiste o la maschera non
+  *	    contiene alcuna CPU esistente.
+ */
+int setAffinity(int pid, U32 mask)
+{
+	pcb_t *p;
+	int old;
+	
+	if((p = findPcb(pid)) == NULL) return -1;
+	
+	/* Solo le CPU effettivamente in uso */
+	mask &= CPU_ONLINE_MASK;
+	if(mask == 0) return -1;
+	
+	old = (int) (p->p_affinity & CPU_ONLINE_MASK);
+	setAffinityMask(p, mask);
+	
+	return old;
+}
+
+/**
+  * @brief (SYS28) Imposta lo slack dei timer di un processo: di quanto le sue DELAY possono
+  *	   scadere in ritardo per essere accorpate ad altri risvegli. I processi sensibili alla
+  *	   latenza lo riducono (0 per scadenze precise).
+  * @param pid : identificativo del processo (-1 per il processo chiamante).
+  * @param slack : nuovo slack in microsecondi (al più TIMER_SLACK_MAX).
+  * @return Restituisce lo slack precedente, -1 se il processo non esiste.
+ */
+int setSlack(int pid, U32 slack)
+{
+	pcb_t *p;
+	int old;
+	
+	if((p = findPcb(pid)) == NULL) return -1;
+	
+	old = (int) p->p_slack;
+	p->p_slack = MIN(slack, TIMER_SLACK_MAX);
+	
+	return old;
+}
@@ -9,8 +9,18 @@
 #include <pcb.e>
 
 /* Inclusioni phase2 */
+#include <bcache.e>
+#include <clock.e>
+#include <cpu.e>
+#include <disk.e>
 #include <exceptions.e>
+#include <interrupts.e>
+#include <ktimer.e>
+#include <latency.e>
+#include <lock.e>
 #include <scheduler.e>
+#include <terminal.e>
+#include <twheel.e>
 
 /* Inclusioni uMPS */
 #include <libumps.e>
@@ -22,9 +32,10 @@ extern void test(void);
   * @brief Funzione che popola le New Areas
   * @param area : indirizzo dell'area da popolare
   * @param handler : inidirizzo del gestore dell'area
+  * @param stack : stack del nucleo della CPU a cui appartiene l'area
   * @return void.
  */
-HIDDEN void populate(memaddr area, memaddr handler)
+HIDDEN void populate(memaddr area, memaddr handler, memaddr stack)
 {
 	/* Nuova area da popolare */
 	state_t *newArea;
@@ -38,7 +49,7 @@ HIDDEN void populate(memaddr area, memaddr handler)
 	/* Imposta il PC all'indirizzo del gestore delle eccezioni */
 	newArea->pc_epc = newArea->reg_t9 = handler;
 	
-	newArea->reg_sp = RAMTOP;
+	newArea->reg_sp = stack;
 	
 	/* Interrupt mascherati, Memoria Virtuale spenta, Kernel Mode attivo */
 	newArea->status = (newArea->status | STATUS_KUc) & ~STATUS_INT_UNMASKED & ~STATUS_VMp;
@@ -46,16 +57,6 @@ HIDDEN void populate(memaddr area, memaddr handler)
 
 /* Dichiarazione delle variabili globali */
 
-/**
-  * @brief Coda di processi in attesa di esecuzione
- */
-struct list_head readyQueue;
-
-/**
-  * @brief Puntatore al pcb del processo in esecuzione
- */
-pcb_t *currentProcess;
-
 /**
   * @brief Contatore dei processi
  */
@@ -71,11 +72,6 @@ U32 pidCount;
  */
 U32 softBlockCount;
 
-/**
-  * @brief Tabella degli STATUS WORD dei device
- */
-int statusWordDev[STATUS_WORD_ROWS][STATUS_WORD_COLS];
-
 /**
   * @brief Struttura dei Semafori
   * @note 8 linee di Interrupt per ogni dispositivo
@@ -91,29 +87,58 @@ struct {
 } sem;
 
 /**
-  * @brief Semaforo dello pseudo-clock
+  * @brief Lock dei semafori dei device e delle code dei loro completamenti
  */
-int pseudo_clock;
+spinlock_t devSemLock;
 
 /**
-  * @brief Tempo d'avvio del processo corrente sul processore
+  * @brief Semaforo dello pseudo-clock
  */
-cpu_t processTOD;
+int pseudo_clock;
 
 /**
-  * @brief Cronometro per riconoscere il tick (ogni 100 millisecondi)
+  * @brief Tabella dei pcb utilizzati
  */
-int timerTick;
+pcb_pid_t pcbused_table[MAXPROC];
 
+#if NCPU > 1
 /**
-  * @brief Tempo d'avvio dello pseudo-clock tick
+  * @brief Punto d'ingresso delle CPU diverse dalla 0: attende il lock del nucleo e chiama lo scheduler.
+  * @return void.
  */
-cpu_t startTimerTick;
+HIDDEN void cpuStart()
+{
+	kernelEntry();
+	
+	scheduler();
+}
 
 /**
-  * @brief Tabella dei pcb utilizzati
+  * @brief Avvia le CPU diverse dalla 0, ciascuna con le proprie New Areas e il proprio stack del nucleo.
+  * @return void.
  */
-pcb_pid_t pcbused_table[MAXPROC];
+HIDDEN void cpuBoot()
+{
+	state_t startState;
+	memaddr stack;
+	int i;
+	
+	for(i=1; i<cpuCount; i++)
+	{
+		stack = (memaddr) &cpuStacks[i][KSTACK_SIZE / WORD_SIZE];
+		
+		populate((memaddr) &cpuAreas[i][AREA_SYSBK_NEW], (memaddr) sysBpHandler, stack);
+		populate((memaddr) &cpuAreas[i][AREA_PGMTRAP_NEW], (memaddr) pgmTrapHandler, stack);
+		populate((memaddr) &cpuAreas[i][AREA_TLB_NEW], (memaddr) tlbHandler, stack);
+		populate((memaddr) &cpuAreas[i][AREA_INT_NEW], (memaddr) intHandler, stack);
+		
+		/* La CPU parte in Kernel Mode, con interrupt mascherati, sullo stack del nucleo */
+		populate((memaddr) &startState, (memaddr) cpuStart, stack);
+		
+		INITCPU(i, &startState, cpuAreas[i]);
+	}
+}
+#endif
 
 /**
   * @brief Inizializzazione del nucleo.
@@ -124,29 +149,42 @@ int main(void)
 	pcb_t *init;
 	int i;
 
-	/* Popolazione delle 4 nuove aree nella ROM Reserved Frame */
+	/* Popolazione delle 4 nuove aree nella ROM Reserved Frame (CPU 0) */
 	
 	/*	SYS/BP Exception Handling	*/
-	populate(SYSBK_NEWAREA, (memaddr) sysBpHandler);
+	populate(SYSBK_NEWAREA, (memaddr) sysBpHandler, RAMTOP);
 	
 	/*	PgmTrap Exception Handling	*/
-	populate(PGMTRAP_NEWAREA, (memaddr) pgmTrapHandler);
+	populate(PGMTRAP_NEWAREA, (memaddr) pgmTrapHandler, RAMTOP);
 	
 	/*	TLB Exception Handling		*/
-	populate(TLB_NEWAREA, (memaddr) tlbHandler);
+	populate(TLB_NEWAREA, (memaddr) tlbHandler, RAMTOP);
 	
 	/*	Interrupt Exception Handling	*/
-	populate(INT_NEWAREA, (memaddr) intHandler);
+	populate(INT_NEWAREA, (memaddr) intHandler, RAMTOP);
 
+	/* Inizializzazione dell'orologio del nucleo */
+	clockInit();
+	twInit(kernelNow);
+	
 	/* Inizializzazione delle strutture dati del livello 2 (phase1) */
 	initPcbs();
 	initSemd();
 	
+	/* Inizializzazione dello stato delle CPU (Ready Queue, Old Areas) */
+	cpuInit();
+	irtInit();
+	lockInit(&kernelLock, LOCK_RANK_KERNEL);
+	lockInit(&devSemLock, LOCK_RANK_DEVSEM);
+	
+	/* Da qui la CPU 0 è nel nucleo */
+	kernelEntry();
+	kernelLockAcquire();
+	
 	/* Inizializzazione delle variabili globali */
-	mkEmptyProcQ(&readyQueue);
-	currentProcess = NULL;
+	initQuotaGroups();
+	initMutexes();
 	processCount = softBlockCount = pidCount = 0;
-	timerTick = 0;
 	
 	/* Inizializzazione della tabella dei pcb utilizzati */
 	for(i=0; i<MAXPROC; i++)
@@ -166,6 +204,13 @@ int main(void)
 		sem.terminalT[i] = 0;
 	}
 	
+	/* Costruzione della tabella dei device installati */
+	intDevicesInit();
+	latInit();
+	termInit();
+	diskInit();
+	bcacheInit();
+	
 	/* Inizializzazione del semaforo dello pseudo-clock */
 	pseudo_clock = 0;
 	
@@ -192,12 +237,18 @@ int main(void)
 	pcbused_table[0].pcb = init;
 
 	/* Inserisce init nella coda di processi Ready */
-	insertProcQ(&readyQueue, init);
+	insertReady(init);
 	
 	processCount++;
 	
-	/* Avvio il tempo per il calcolo dello pseudo-clock tick */
-	startTimerTick = GET_TODLOW;
+	/* Avvio dei timer del nucleo: pseudo-clock tick, quanto e campionamento del carico */
+	intTimersInit();
+	initLoadAvg();
+	ktimerProgram();
+	
+#if NCPU > 1
+	cpuBoot();
+#endif
 	
 	scheduler();
 	
@@ -11,290 +11,661 @@
 #include <pcb.e>
 
 /* Inclusioni phase2 */
+#include <bcache.e>
+#include <clock.e>
+#include <cpu.e>
+#include <disk.e>
 #include <exceptions.e>
 #include <initial.e>
 #include <interrupts.e>
+#include <ktimer.e>
+#include <latency.e>
+#include <lock.e>
 #include <scheduler.e>
+#include <terminal.e>
 
 /* Inclusioni uMPS */
 #include <libumps.e>
 
-/* Old Area dell'Interrupt */
-HIDDEN state_t *int_old_area = (state_t *) INT_OLDAREA;
+#include <bitops.h>
 
-/* Indirizzo base del device */
-HIDDEN memaddr devAddrBase;
+/* Old Area dell'Interrupt (della CPU corrente) */
+#define int_old_area (thisCpu->c_intOld)
 
-/* Variabili per accedere ai campi status e command di device o terminali */
-HIDDEN int *rStatus, *tStatus;
-HIDDEN int *rCommand, *tCommand;
-HIDDEN int recvStatByte, transmStatByte;
-HIDDEN int *status, *command;
+/**
+  * @brief Tabella dei device, costruita all'avvio da intDevicesInit (una riga per linea, più una
+  *	  per la metà in ricezione dei terminali)
+ */
+device_t devTable[DEV_TABLE_ROWS][DEV_PER_INT];
+
+/**
+  * @brief Bitmap dei device installati, per linea
+ */
+HIDDEN U32 devInstalled[DEV_USED_INTS];
+
+/**
+  * @brief Massimo tempo (microsecondi) trascorso a interrupt mascherati dalle sole top half
+ */
+U32 intTopHalfMax;
+
+/**
+  * @brief Massimo tempo (microsecondi) dall'ingresso nel gestore degli interrupt allo scheduler,
+  *	  bottom half comprese: tutto a interrupt mascherati prima degli interrupt annidati
+ */
+U32 intHandlerMax;
+
+/**
+  * @brief Massimo tempo (microsecondi) trascorso a interrupt mascherati, senza interruzioni,
+  *	  all'interno del gestore degli interrupt
+ */
+U32 intMaskedMax;
+
+/**
+  * @brief Stack dei livelli annidati del gestore degli interrupt, per CPU
+ */
+HIDDEN U32 intStacks[NCPU][INT_NEST_MAX][INT_STACK_SIZE / WORD_SIZE];
+
+/**
+  * @brief Linee di priorità più alta di ciascuna linea, le sole smascherate mentre la si serve:
+  *	  dopo IPI, timer locale e Interval Timer vengono i terminali, poi gli altri device
+ */
+HIDDEN const U32 higherLines[INT_LINES] = { 0x00, 0x01, 0x03, 0x87, 0x8F, 0x9F, 0xBF, 0x07 };
+
+/**
+  * @brief Linee in ordine di priorità decrescente
+ */
+HIDDEN const int lineOrder[INT_LINES] = { INT_IPI, INT_LOCAL_TIMER, INT_TIMER, INT_TERMINAL, INT_DISK, INT_TAPE, INT_UNUSED, INT_PRINTER };
+
+/**
+  * @brief Calcola la cima dello stack di un livello del gestore degli interrupt.
+  * @param depth : livello (0 è quello più esterno, che usa lo stack del nucleo della CPU).
+  * @return Ritorna l'indirizzo della cima dello stack.
+ */
+HIDDEN memaddr intStackTop(int depth)
+{
+	if(depth == 0) return thisCpu->c_intStack;
+	
+	return (memaddr) &intStacks[CPU_ID][depth - 1][INT_STACK_SIZE / WORD_SIZE];
+}
+
+/**
+  * @brief Maschera gli interrupt e fa partire la misura del tratto a interrupt mascherati.
+  * @return void.
+ */
+HIDDEN void intMask()
+{
+	setSTATUS(getSTATUS() & ~STATUS_IEc);
+	thisCpu->c_maskedSince = clockRead();
+}
 
 /**
-  * @brief Riconosce il device che ha un interrupt pendente sulla bitmap passata per parametro.
-  * @param bitMapDevice : bitmap degli interrupt pendenti per linea di interrupt.
-  * @return Ritorna l'indice del device che ha un interrupt pendente su quella bitmap.
+  * @brief Chiude la misura del tratto a interrupt mascherati.
+  * @return void.
  */
-HIDDEN int recognizeDev(int bitMapDevice)
+HIDDEN void maskedEnd()
 {
-	if(bitMapDevice == (bitMapDevice | DEV_CHECK_ADDRESS_0)) return DEV_CHECK_LINE_0;
-	else if(bitMapDevice == (bitMapDevice | DEV_CHECK_ADDRESS_1)) return DEV_CHECK_LINE_1;
-	else if(bitMapDevice == (bitMapDevice | DEV_CHECK_ADDRESS_2)) return DEV_CHECK_LINE_2;
-	else if(bitMapDevice == (bitMapDevice | DEV_CHECK_ADDRESS_3)) return DEV_CHECK_LINE_3;
-	else if(bitMapDevice == (bitMapDevice | DEV_CHECK_ADDRESS_4)) return DEV_CHECK_LINE_4;
-	else if(bitMapDevice == (bitMapDevice | DEV_CHECK_ADDRESS_5)) return DEV_CHECK_LINE_5;
-	else if(bitMapDevice == (bitMapDevice | DEV_CHECK_ADDRESS_6)) return DEV_CHECK_LINE_6;
-	else return DEV_CHECK_LINE_7;
+	U32 masked;
+	
+	masked = (U32) (clockRead() - thisCpu->c_maskedSince);
+	if(masked > intMaskedMax) intMaskedMax = masked;
 }
 
 /**
-  * @brief Sblocca il processo sul semaforo del device che ha causato l'interrupt.
-  *	   Se non c'è nessun processo da bloccare si aggiorna la matrice degli status word dei device,
-  *	   altrimenti si inserisce nella readyQueue.
-  * @param *semaddr : indirizzo del semaforo associato al device che ha causato l'interrupt
+  * @brief Chiude la misura del tratto a interrupt mascherati e abilita le linee indicate.
+  * @param lines : bitmap delle linee da smascherare.
+  * @return void.
+ */
+HIDDEN void intUnmask(U32 lines)
+{
+	maskedEnd();
+	
+	setSTATUS((getSTATUS() & ~STATUS_INT_UNMASKED) | STATUS_IM(lines) | STATUS_IEc);
+}
+
+/**
+  * @brief Accoda lo status di un completamento che nessuno attendeva ancora. Se la coda è piena
+  *	   il completamento più vecchio viene perso, insieme alla V corrispondente.
+  *	   Va chiamata con devSemLock preso, dopo la V sul semaforo del device.
+  * @param d : descrittore del device.
+  * @param status : status del completamento.
+  * @return void.
+ */
+HIDDEN void devRingPut(device_t *d, U32 status)
+{
+	if(d->d_ringCount == DEV_RING_SIZE)
+	{
+		d->d_ringHead++;
+		d->d_ringCount--;
+		d->d_ringLost++;
+		(*d->d_sem)--;
+	}
+	
+	d->d_ring[(d->d_ringHead + d->d_ringCount) & DEV_RING_MASK] = status;
+	d->d_ringCount++;
+}
+
+/**
+  * @brief Ritira lo status del completamento più vecchio di un device (ce n'è almeno uno se la P
+  *	   sul suo semaforo non ha bloccato). Va chiamata con devSemLock preso.
+  * @param d : descrittore del device.
+  * @return Ritorna lo status del completamento.
+ */
+U32 devRingGet(device_t *d)
+{
+	U32 status;
+	
+	status = d->d_ring[d->d_ringHead & DEV_RING_MASK];
+	d->d_ringHead++;
+	d->d_ringCount--;
+	
+	return status;
+}
+
+/**
+  * @brief Conta i completamenti persi a coda piena da tutti i device (GETSYSSTATS).
+  * @return Ritorna il numero di completamenti persi.
+ */
+U32 devRingLost()
+{
+	U32 lost = 0;
+	int i, j;
+	
+	lockAcquire(&devSemLock);
+	for(i=0; i<DEV_TABLE_ROWS; i++)
+		for(j=0; j<DEV_PER_INT; j++)
+			lost += devTable[i][j].d_ringLost;
+	lockRelease(&devSemLock);
+	
+	return lost;
+}
+
+/**
+  * @brief (Bottom half) Sblocca il processo sul semaforo del device che ha causato l'interrupt.
+  *	   Se non c'è nessun processo da sbloccare si accoda lo status nella coda dei completamenti
+  *	   del device, altrimenti si inserisce il processo nella readyQueue.
+  * @param d : descrittore del device che ha causato l'interrupt
   * @param status : campo del device corrispondente al suo stato
-  * @param line : linea di interrupt su cui è presente l'interrupt pendente da gestire
-  * @param dev : device che ha causato l'interrupt pendente da gestire
-  * @return Ritorna il pcb bloccato sul semaforo del device il cui indirizzo è passato per parametro, se presente
+  * @return void.
  */
-HIDDEN pcb_t *verhogenInt(int *semaddr, int status, int line, int dev)
+HIDDEN void verhogenInt(device_t *d, U32 status)
 {
 	pcb_t *p;
 	
-	(*semaddr)++;
+	lockAcquire(&devSemLock);
+	
+	(*d->d_sem)++;
 	
-	p=removeBlocked((S32 *)semaddr);
-	/* Se non sono stati sbloccati dei processi, ritorna lo status Word del device */
+	p=removeBlocked((S32 *) d->d_sem);
+	/* Se non sono stati sbloccati dei processi, accoda lo status per la prossima WAITIO */
 	if(p == NULL)
-		statusWordDev[line][dev] = status;
-	/* Altrimenti ... */
+		devRingPut(d, status);
+	/* Altrimenti ... (lo status va impostato prima che un'altra CPU possa eseguire il processo) */
 	else {
-		insertProcQ(&readyQueue, p);
-		p->p_isOnDev = FALSE;
-		softBlockCount--;
 		p->p_state.reg_v0 = status;
+		latWake(d, p);
+		atomicAdd(&softBlockCount, -1);
+		insertReady(p);
 	}
 	
-	return p;
+	lockRelease(&devSemLock);
 }
 
 /**
-  * @brief Gestore degli Interrupts.
+  * @brief Accoda alla CPU corrente il lavoro differito di un interrupt. La coda è più grande di
+  *	   tutto il lavoro che può essere in sospeso: ogni device ne accoda al più uno prima che
+  *	   un processo gli dia un nuovo comando.
+  * @param func : bottom half da eseguire.
+  * @param d : descrittore del device (NULL per i timer).
+  * @param status : stato del device letto dalla top half.
   * @return void.
  */
-void intHandler()
+void queueWork(void (*func)(device_t *d, U32 status), device_t *d, U32 status)
 {
-	int cause_int;
-	int *bitMapDevice;
-	int devNumb;
-	pcb_t *p;
+	work_t *w;
+	U32 s;
 	
-	/* Se è presente un processo sulla CPU, carica la Interrupt Old Area su di esso */
-	if(currentProcess != NULL)
-		saveCurrentState(int_old_area, &(currentProcess->p_state));
+	/* Le top half annidate accodano sulla stessa coda */
+	s = getSTATUS();
+	setSTATUS(s & ~STATUS_IEc);
 	
-	/* Recupera il contenuto del registro cause */
-	cause_int = int_old_area->cause;
+	if((thisCpu->c_workTail - thisCpu->c_workHead) >= INT_WORK_MAX) PANIC();
 	
-	/* Se la causa dell'interrupt è la linea 2 (la linea 0 e la 1 si ignorano poichè Kaya non genererà interrupt software) */
-	if(CAUSE_IP_GET(cause_int, INT_TIMER))
+	w = &thisCpu->c_work[thisCpu->c_workTail & INT_WORK_MASK];
+	w->w_func = func;
+	w->w_dev = d;
+	w->w_status = status;
+	thisCpu->c_workTail++;
+	
+	setSTATUS(s);
+}
+
+/**
+  * @brief Esegue il lavoro differito accodato sulla CPU corrente, con tutti gli interrupt
+  *	   abilitati: i gestori annidati eseguono solo top half, che non toccano semafori né Ready
+  *	   Queue. I soli lock che prendono sono quelli dei terminali e dei dischi: fuori dalle
+  *	   top half chi li detiene maschera tutti gli interrupt, e una top half li detiene con
+  *	   smascherate solo le linee di priorità più alta (0-2, i cui gestori non prendono lock,
+  *	   e per i dischi i terminali, che prendono il loro). Ritorna a interrupt mascherati,
+  *	   con la coda vuota.
+  * @return void.
+ */
+HIDDEN void runDeferredWork()
+{
+	work_t w;
+	
+	while(TRUE)
 	{
-		/* Aggiorna il tempo trascorso */
-		timerTick += (GET_TODLOW - startTimerTick);
-		startTimerTick = GET_TODLOW;
+		intMask();
+		if(thisCpu->c_workHead == thisCpu->c_workTail) return;
 		
-		/* Se è arrivato l'interrupt dallo pseudo-clock */
-		if(timerTick >= SCHED_PSEUDO_CLOCK)
+		/* Copiato prima di liberarne il posto nella coda */
+		w = thisCpu->c_work[thisCpu->c_workHead & INT_WORK_MASK];
+		thisCpu->c_workHead++;
+		
+		intUnmask(0xFF);
+		w.w_func(w.w_dev, w.w_status);
+	}
+}
+
+/**
+  * @brief Gestisce la scadenza del quanto del processo corrente.
+  * @return void.
+ */
+HIDDEN void sliceExpired()
+{
+	/* In modalità tickless, se nessun altro processo è pronto, il processo corrente prosegue
+	   e lo scheduler riprogramma il timer per il prossimo evento reale */
+	if(!(SCHED_TICKLESS && emptyProcQ(&readyQueue)))
+	{
+		/* Reinserisce il processo nella Ready Queue */
+		preemptCurrent(TRUE);
+		
+		atomicAdd(&softBlockCount, 1);
+	}
+}
+
+/**
+  * @brief Timer periodico dello pseudo-clock tick
+ */
+HIDDEN ktimer_t pseudoClockTimer;
+
+/**
+  * @brief Pseudo-clock tick (ogni SCHED_PSEUDO_CLOCK): sblocca i processi in attesa sullo
+  *	   pseudo-clock, ricarica i gruppi di quota e scrive i blocchi modificati della cache.
+  * @param k : timer dello pseudo-clock.
+  * @return void.
+ */
+HIDDEN void pseudoClockTick(ktimer_t *k)
+{
+	pcb_t *p;
+	
+	/* Se sono state fatte più SYS7 precedentemente */
+	if(pseudo_clock < 0)
+	{
+		/* Sblocca tutti i processi bloccati */
+		while(pseudo_clock < 0)
 		{
-			/* Se sono state fatte più SYS7 precedentemente */
-			if(pseudo_clock < 0)
-			{
-				/* Sblocca tutti i processi bloccati */
-				while(pseudo_clock < 0)
-				{
-					p = removeBlocked(&pseudo_clock);
-					/* Se sono stati sbloccati dei processi ... */
-					if(!(p == NULL))
-					{ 	/* Se pseudo_clock < 0 deve esserci almeno un processo bloccato */
-						insertProcQ(&readyQueue, p);
-						p->p_isOnDev = FALSE;
-						softBlockCount--;
-					}
-					pseudo_clock++;
-				}
+			p = removeBlocked(&pseudo_clock);
+			/* Se sono stati sbloccati dei processi ... */
+			if(!(p == NULL))
+			{ 	/* Se pseudo_clock < 0 deve esserci almeno un processo bloccato */
+				insertReady(p);
+				atomicAdd(&softBlockCount, -1);
 			}
-			else
-			{
-				p = removeBlocked(&pseudo_clock);
-				/* Se non viene sbloccato nessun processo (pseudo-V), decrementa lo pseudo-clock */
-				if(p == NULL) pseudo_clock--;
-				/* Altrimenti esegue la V sullo pseudo-clock */
-				else
-				{
-					insertProcQ(&readyQueue, p);
-					p->p_isOnDev = FALSE;
-					softBlockCount--;
-					pseudo_clock++;
-				}
-			}
-			
-			/* Riavvia il tempo per il calcolo dello pseudo-clock tick */
-			timerTick = 0;
-			startTimerTick = GET_TODLOW;
+			pseudo_clock++;
 		}
-		/* Se è finito il timeslice del processo corrente */
-		else if(currentProcess != NULL)
+	}
+	else
+	{
+		p = removeBlocked(&pseudo_clock);
+		/* Se non viene sbloccato nessun processo (pseudo-V), decrementa lo pseudo-clock */
+		if(p == NULL) pseudo_clock--;
+		/* Altrimenti esegue la V sullo pseudo-clock */
+		else
 		{
-			/* Reinserisce il processo nella Ready Queue */
-			insertProcQ(&readyQueue, currentProcess);
+			insertReady(p);
+			atomicAdd(&softBlockCount, -1);
+			pseudo_clock++;
+		}
+	}
+	
+	/* Ricarica i gruppi di quota il cui periodo è terminato */
+	quotaTick();
+	
+	/* Scrive sul disco i blocchi modificati della cache */
+	bcacheFlush();
+}
 
-			currentProcess = NULL;
-			softBlockCount++;
-			
-			/* Aggiorna il tempo trascorso */
-			timerTick += (GET_TODLOW - startTimerTick);
-			startTimerTick = GET_TODLOW;
+/**
+  * @brief Scadenza del quanto con una sola CPU (con più CPU si usa il timer locale).
+  * @param k : timer del quanto della CPU.
+  * @return void.
+ */
+HIDDEN void sliceTimerExpired(ktimer_t *k)
+{
+	if(currentProcess != NULL) sliceExpired();
+}
+
+/**
+  * @brief Inizializza i timer del nucleo gestiti da questo modulo: lo pseudo-clock tick e il
+  *	   timer del quanto di ogni CPU.
+  * @return void.
+ */
+void intTimersInit()
+{
+	int i;
+	
+	ktimerInit(&pseudoClockTimer, pseudoClockTick);
+	ktimerArmPeriodic(&pseudoClockTimer, kernelNow + SCHED_PSEUDO_CLOCK, SCHED_PSEUDO_CLOCK);
+	
+	for(i=0; i<NCPU; i++)
+		ktimerInit(&cpuData[i].c_sliceTimer, sliceTimerExpired);
+}
+
+/**
+  * @brief Linea 0 (solo con più CPU): un'altra CPU ha reso pronto (o terminato) un processo per
+  *	   questa CPU, basta ripassare dallo scheduler.
+  * @param line : linea di interrupt.
+  * @return void.
+ */
+HIDDEN void ipiInt(int line)
+{
+	cpuKickAck();
+}
+
+/**
+  * @brief (Bottom half) Scadenza del quanto segnalata dal timer locale.
+  * @param d : non usato.
+  * @param status : non usato.
+  * @return void.
+ */
+HIDDEN void sliceWork(device_t *d, U32 status)
+{
+	if(currentProcess != NULL) sliceExpired();
+}
+
+/**
+  * @brief Linea 1 (solo con più CPU), il timer locale della CPU: scade il quanto, oppure una CPU
+  *	   inattiva deve controllare le code delle altre. Il timer locale viene fermato: lo
+  *	   scheduler lo riprogramma comunque.
+  * @param line : linea di interrupt.
+  * @return void.
+ */
+HIDDEN void localTimerInt(int line)
+{
+	/* ACK: resterebbe pendente mentre si servono le linee di priorità più bassa */
+	clockSetSliceTimer(TIMER_INFINITE);
+	
+	queueWork(sliceWork, NULL, 0);
+}
+
+/**
+  * @brief (Bottom half) Esegue i timer scaduti (pseudo-clock, DELAY, quanto con una sola CPU,
+  *	   campionamento del carico) e riprogramma l'Interval Timer.
+  * @param d : non usato.
+  * @param status : non usato.
+  * @return void.
+ */
+HIDDEN void timerWork(device_t *d, U32 status)
+{
+	/* I timer del nucleo sono protetti da kernelLock (rilasciato da kernelExit) */
+	kernelLockAcquire();
+	
+	ktimerRun();
+}
+
+/**
+  * @brief Linea 2, l'Interval Timer: la top half riconosce l'interrupt ricaricando il timer (la
+  *	   bottom half lo riprogramma per la prossima scadenza).
+  * @param line : linea di interrupt.
+  * @return void.
+ */
+HIDDEN void intervalTimerInt(int line)
+{
+	clockSetTimer(KTIMER_MAX_WAIT);
+	
+	queueWork(timerWork, NULL, 0);
+}
+
+/**
+  * @brief (Top half) Interrupt di un disco, di un nastro, di una scheda di rete o di una
+  *	   stampante: riconosce l'interrupt e accoda la V sul semaforo del device.
+  * @param d : descrittore del device.
+  * @return void.
+ */
+HIDDEN void dtpInt(device_t *d)
+{
+	U32 status = d->d_reg->dtp.status;
+	
+	/* ACK per il riconoscimento dell'interrupt pendente */
+	d->d_reg->dtp.command = DEV_C_ACK;
+	latAck(d);
+	
+	/* La V sul semaforo associato al device è differita */
+	queueWork(verhogenInt, d, status);
+}
+
+/**
+  * @brief (Top half) Interrupt di un disco: se il comando veniva dalla coda delle richieste
+  *	   (DISK_PUT, DISK_GET) il successivo parte subito, altrimenti è un completamento per WAITIO.
+  * @param d : descrittore del disco.
+  * @return void.
+ */
+HIDDEN void diskInt(device_t *d)
+{
+	if(diskIntr(d)) latAck(d);
+	else dtpInt(d);
+}
+
+/**
+  * @brief Interrupt di un terminale risparmiati: trasmissione e ricezione completate insieme e servite nello stesso interrupt
+ */
+U32 termIrqSaved;
+
+/**
+  * @brief (Top half) Interrupt di un terminale: riconosce sia la trasmissione che la ricezione,
+  *	   se entrambe completate, e ne accoda le V.
+  * @param d : descrittore della metà in trasmissione del terminale.
+  * @return void.
+ */
+HIDDEN void terminalInt(device_t *d)
+{
+	termreg_t *reg = &d->d_reg->term;
+	int served = 0;
+	
+	/* Se è un carattere trasmesso (o la trasmissione è fallita) */
+	if(TERM_DONE(reg->transm_status))
+	{
+		/* Se il carattere veniva dalla coda di una WRITETERMINAL, il successivo parte subito */
+		if(!termTxIntr(d))
+		{
+			/* Differisce la V sul semaforo associato al device che ha causato l'interrupt */
+			queueWork(verhogenInt, d, reg->transm_status);
+			/* ACK per il riconoscimento dell'interrupt pendente (o comando per i caratteri accodati nel frattempo) */
+			termTxResume(d);
 		}
-		/* Altre cause */
-		else
-			SET_IT(SCHED_PSEUDO_CLOCK - timerTick);
+		latAck(d);
+		served++;
 	}
-	/* Se la causa dell'interrupt è la linea 3 */
-	else if(CAUSE_IP_GET(cause_int, INT_DISK))
-	{	
-		/* Dall'indirizzo iniziale delle bitmap degli interrupt pendenti si accede a quella corrispondente alla propria linea */
-		bitMapDevice =(int *) (PENDING_BITMAP_START + (WORD_SIZE * (INT_DISK - DEV_DIFF)));
-		
-		/* Cerca all'interno della bitmap di questa specifica linea qual è il device con priorità più alta con un interrupt pendente */
-		devNumb = recognizeDev(*bitMapDevice);
-		
-		/* Cerca l'indirizzo del device */
-		devAddrBase = (memaddr) (DEV_REGS_START + ((INT_DISK - DEV_DIFF) * CHECK_EIGHTH_BIT) + (devNumb * CHECK_FIFTH_BIT));
-		
-		/* Recupera il campo status del device */
-		status = (int*) (devAddrBase + DEV_REG_STATUS);
-		/* Recupera il campo command del device */
-		command = (int *) (devAddrBase + DEV_REG_COMMAND);
 	
-		/* Compie una V sul semaforo associato al device che ha causato l'interrupt */
-		p = verhogenInt(&sem.disk[devNumb], (*status), INT_DISK - DEV_DIFF, devNumb);
-		
-		/* ACK per il riconoscimento dell'interrupt pendente */
-		(*command) = DEV_C_ACK;
+	/* Se è un carattere ricevuto (o la ricezione è fallita) */
+	if(TERM_DONE(reg->recv_status))
+	{
+		/* Se il ricevitore è pilotato dalla disciplina di linea, il carattere va nella sua coda */
+		if(!termRxIntr(&devTable[DEV_ROW(INT_TERMINAL, TRUE)][d->d_dev]))
+		{
+			queueWork(verhogenInt, &devTable[DEV_ROW(INT_TERMINAL, TRUE)][d->d_dev], reg->recv_status);
+			reg->recv_command = DEV_C_ACK;
+		}
+		latAck(&devTable[DEV_ROW(INT_TERMINAL, TRUE)][d->d_dev]);
+		served++;
 	}
-	/* Se la causa dell'interrupt è la linea 4 */
-	else if(CAUSE_IP_GET(cause_int, INT_TAPE))
+	
+	if(served > 1) termIrqSaved++;
+}
+
+/**
+  * @brief Linee 3-7: chiama il gestore di ogni device installato della linea con un interrupt pendente.
+  * @param line : linea di interrupt.
+  * @return void.
+ */
+HIDDEN void deviceInt(int line)
+{
+	U32 bits;
+	int dev;
+	
+	/* Scorre la bitmap degli interrupt pendenti della linea, un bit alla volta */
+	bits = *PENDING_BITMAP(line) & devInstalled[line - DEV_DIFF];
+	while(bits != 0)
 	{
-		/* Dall'indirizzo iniziale delle bitmap degli interrupt pendenti si accede a quella corrispondente alla propria linea */
-		bitMapDevice =(int *) (PENDING_BITMAP_START + (WORD_SIZE * (INT_TAPE - DEV_DIFF)));
-		
-		/* Cerca all'interno della bitmap di questa specifica linea qual è il device con priorità più alta con un interrupt pendente */
-		devNumb = recognizeDev(*bitMapDevice);
-		
-		/* Cerca l'indirizzo del device */
-		devAddrBase = (memaddr) (DEV_REGS_START + ((INT_TAPE - DEV_DIFF) * CHECK_EIGHTH_BIT) + (devNumb * CHECK_FIFTH_BIT));
-		
-		/* Recupera il campo status del device */
-		status = (int*) (devAddrBase + DEV_REG_STATUS);
-		/* Recupera il campo command del device */
-		command = (int *) (devAddrBase + DEV_REG_COMMAND);
-		
-		/* Compie una V sul semaforo associato al device che ha causato l'interrupt */
-		p = verhogenInt(&sem.tape[devNumb], (*status), INT_TAPE - DEV_DIFF, devNumb);
+		dev = ctz32(bits);
+		bits &= bits - 1;
 		
-		/* ACK per il riconoscimento dell'interrupt pendente */
-		(*command) = DEV_C_ACK;
+		devTable[line - DEV_DIFF][dev].d_handler(&devTable[line - DEV_DIFF][dev]);
 	}
-	/* Se la causa dell'interrupt è la linea 5 */
-	else if(CAUSE_IP_GET(cause_int, INT_UNUSED))
+}
+
+/**
+  * @brief Costruisce la tabella dei device dalla bitmap dei device installati: registro, semaforo,
+  *	   coda dei completamenti e gestore di ogni device.
+  * @return void.
+ */
+void intDevicesInit()
+{
+	int row, line, dev;
+	device_t *d;
+	
+	for(row=0; row<DEV_TABLE_ROWS; row++)
 	{
-		/* Dall'indirizzo iniziale delle bitmap degli interrupt pendenti si accede a quella corrispondente alla propria linea */
-		bitMapDevice =(int *) (PENDING_BITMAP_START + (WORD_SIZE * (INT_UNUSED - DEV_DIFF)));
-		
-		/* Cerca all'interno della bitmap di questa specifica linea qual è il device con priorità più alta con un interrupt pendente */
-		devNumb = recognizeDev(*bitMapDevice);
+		/* L'ultima riga è la metà in ricezione dei terminali */
+		line = MIN(row + DEV_DIFF, INT_TERMINAL);
+		if(row < DEV_USED_INTS) devInstalled[row] = *INST_BITMAP(line);
 		
-		/* Cerca l'indirizzo del device */
-		devAddrBase = (memaddr) (DEV_REGS_START + ((INT_UNUSED - DEV_DIFF) * CHECK_EIGHTH_BIT) + (devNumb * CHECK_FIFTH_BIT));
-		
-		/* Recupera il campo status del device */
-		status = (int*) (devAddrBase + DEV_REG_STATUS);
-		/* Recupera il campo command del device */
-		command = (int *) (devAddrBase + DEV_REG_COMMAND);
-		
-		/* Compie una V sul semaforo associato al device che ha causato l'interrupt */
-		p = verhogenInt(&sem.network[devNumb], (*status), INT_UNUSED - DEV_DIFF, devNumb);
-		
-		/* ACK per il riconoscimento dell'interrupt pendente */
-		(*command) = DEV_C_ACK;
+		for(dev=0; dev<DEV_PER_INT; dev++)
+		{
+			d = &devTable[row][dev];
+			
+			d->d_line = line;
+			d->d_dev = dev;
+			d->d_ringHead = d->d_ringCount = d->d_ringLost = 0;
+			d->d_reg = (devInstalled[line - DEV_DIFF] & (1U << dev)) ? (devreg_t *) DEV_REG_ADDR(line, dev) : NULL;
+			
+			switch(row)
+			{
+				case INT_DISK - DEV_DIFF: d->d_sem = &sem.disk[dev]; break;
+				case INT_TAPE - DEV_DIFF: d->d_sem = &sem.tape[dev]; break;
+				case INT_UNUSED - DEV_DIFF: d->d_sem = &sem.network[dev]; break;
+				case INT_PRINTER - DEV_DIFF: d->d_sem = &sem.printer[dev]; break;
+				case INT_TERMINAL - DEV_DIFF: d->d_sem = &sem.terminalT[dev]; break;
+				default: d->d_sem = &sem.terminalR[dev];
+			}
+			
+			if(row == DEV_ROW(INT_TERMINAL, FALSE)) d->d_handler = terminalInt;
+			else if(row == DEV_ROW(INT_TERMINAL, TRUE)) d->d_handler = NULL;
+			else if(row == DEV_ROW(INT_DISK, FALSE)) d->d_handler = diskInt;
+			else d->d_handler = dtpInt;
+		}
 	}
-	/* Se la causa dell'interrupt è la linea 6 */
-	else if(CAUSE_IP_GET(cause_int, INT_PRINTER))
+}
+
+/**
+  * @brief Gestori degli interrupt, per linea
+ */
+HIDDEN void (*lineHandler[INT_LINES])(int line) = {
+	ipiInt, localTimerInt, intervalTimerInt, deviceInt, deviceInt, deviceInt, deviceInt, deviceInt
+};
+
+/**
+  * @brief Gestore degli Interrupts, annidabile per priorità. Le top half servono le linee pendenti
+  *	   in ordine di priorità, ciascuna con smascherate le sole linee di priorità più alta, e su
+  *	   ogni linea di device tutti i device con un interrupt pendente. Un livello annidato torna
+  *	   al livello interrotto; quello più esterno esegue il lavoro differito (semafori e Ready
+  *	   Queue) e chiama lo scheduler una sola volta.
+  * @return void.
+ */
+void intHandler()
+{
+	U32 pending, masked;
+	tod_t entry;
+	int depth, i, line;
+#ifdef LAT_HIST
+	tod_t latOuter = thisCpu->c_latEntry;
+#endif
+	
+	depth = thisCpu->c_intDepth++;
+	
+	if(depth == 0)
 	{
-		/* Dall'indirizzo iniziale delle bitmap degli interrupt pendenti si accede a quella corrispondente alla propria linea */
-		bitMapDevice =(int *) (PENDING_BITMAP_START + (WORD_SIZE * (INT_PRINTER - DEV_DIFF)));
-		
-		/* Cerca all'interno della bitmap di questa specifica linea qual è il device con priorità più alta con un interrupt pendente */
-		devNumb = recognizeDev(*bitMapDevice);
-		
-		/* Cerca l'indirizzo del device */
-		devAddrBase = (memaddr) (DEV_REGS_START + ((INT_PRINTER - DEV_DIFF) * CHECK_EIGHTH_BIT) + (devNumb * CHECK_FIFTH_BIT));
+		/* Contabilizza l'ingresso nel nucleo */
+		kernelEntry();
+		entry = kernelNow;
 		
-		/* Recupera il campo status del device */
-		status = (int*) (devAddrBase + DEV_REG_STATUS);
-		/* Recupera il campo command del device */
-		command = (int *) (devAddrBase + DEV_REG_COMMAND);
-		
-		/* Compie una V sul semaforo associato al device che ha causato l'interrupt */
-		p = verhogenInt(&sem.printer[devNumb], (*status), INT_PRINTER - DEV_DIFF, devNumb);
-		
-		/* ACK per il riconoscimento dell'interrupt pendente */
-		(*command) = DEV_C_ACK;
+		/* Se è presente un processo sulla CPU, carica la Interrupt Old Area su di esso */
+		if(currentProcess != NULL)
+			saveCurrentState(int_old_area, &(currentProcess->p_state));
 	}
-	/* Se la causa dell'interrupt è la linea 7 */
-	else if(CAUSE_IP_GET(cause_int, INT_TERMINAL))
-	{	
-		/* Dall'indirizzo iniziale delle bitmap degli interrupt pendenti si accede a quella corrispondente alla propria linea */
-		bitMapDevice =(int *) (PENDING_BITMAP_START + (WORD_SIZE * (INT_TERMINAL - DEV_DIFF)));
-		
-		/* Cerca all'interno della bitmap di questa specifica linea qual è il device con priorità più alta con un interrupt pendente */
-		devNumb = recognizeDev(*bitMapDevice);
-		
-		/* Cerca l'indirizzo del device */
-		devAddrBase = (memaddr) (DEV_REGS_START + ((INT_TERMINAL - DEV_DIFF) * CHECK_EIGHTH_BIT) + (devNumb * CHECK_FIFTH_BIT));
-		
-		/* Recupera il campo status del device (ricezione) */
-		rStatus     = (int *) (devAddrBase + TERM_R_STATUS);
-		/* Recupera il campo status del device (trasmissione) */
-		tStatus   = (int *) (devAddrBase + TERM_T_STATUS);
-		/* Recupera il campo command del device (ricezione) */
-		rCommand    = (int *) (devAddrBase + TERM_R_COMMAND);
-		/* Recupera il campo command del device (trasmissione) */
-		tCommand  = (int *) (devAddrBase + TERM_T_COMMAND);
+	else
+	{
+		/* Interrupt annidato: salva lo stato del livello interrotto */
+		entry = clockRead();
+		saveCurrentState(int_old_area, &thisCpu->c_intSaved[depth - 1]);
+	}
+	thisCpu->c_maskedSince = entry;
+#ifdef LAT_HIST
+	thisCpu->c_latEntry = entry;
+#endif
+	
+	/* Linee pendenti secondo il registro cause (le linee 0 e 1 si usano solo con più CPU) */
+	pending = CAUSE_IP_BITS(int_old_area->cause);
+	if(NCPU == 1) pending &= ~((1 << INT_IPI) | (1 << INT_LOCAL_TIMER));
+	
+	/* Un livello annidato serve solo le linee smascherate dal livello interrotto: le altre sono
+	   pendenti ma già in servizio più in basso */
+	if(depth > 0) pending &= (int_old_area->status & STATUS_INT_UNMASKED) >> 8;
+	
+	/* Un interrupt che annida su questo livello userà lo stack del livello successivo */
+	thisCpu->c_intNew->reg_sp = intStackTop(depth + 1);
+	
+	/* Dalla linea di priorità più alta */
+	for(i=0; i<INT_LINES; i++)
+	{
+		line = lineOrder[i];
+		if(!(pending & (1U << line))) continue;
 		
-		/* Estrae il byte dello status per capire cosa è avvenuto */
-		recvStatByte   = (*rStatus) & CHECK_STATUS_BIT;
-		transmStatByte = (*tStatus) & CHECK_STATUS_BIT;
-
-		/* Se è un carattere trasmesso */
-		if(transmStatByte == DEV_TTRS_S_CHARTRSM)
-		{
-			/* Compie una V sul semaforo associato al device che ha causato l'interrupt */
-			p = verhogenInt(&sem.terminalT[devNumb], (*tStatus), INT_TERMINAL - DEV_DIFF, devNumb);
-			/* ACK per il riconoscimento dell'interrupt pendente */
-			(*tCommand) = DEV_C_ACK;
-		}
+		/* Conta l'interrupt servito sulla CPU corrente */
+		thisCpu->c_interrupts[line]++;
 		
-		/* Se è un carattere ricevuto */
-		else if(recvStatByte == DEV_TRCV_S_CHARRECV)
-		{
-			/* Compie una V sul semaforo associato al device che ha causato l'interrupt */
-			p = verhogenInt(&sem.terminalR[devNumb], (*rStatus), (INT_TERMINAL - DEV_DIFF) + 1, devNumb);
-			/* ACK per il riconoscimento dell'interrupt pendente */
-			(*rCommand) = DEV_C_ACK;
-		}
+		intUnmask(higherLines[line]);
+		lineHandler[line](line);
+		intMask();
+	}
+	
+	/* Un livello annidato riprende quello interrotto, che eseguirà il lavoro accodato */
+	if(depth > 0)
+	{
+		thisCpu->c_intNew->reg_sp = intStackTop(depth);
+		thisCpu->c_intDepth--;
+#ifdef LAT_HIST
+		thisCpu->c_latEntry = latOuter;
+#endif
+		maskedEnd();
+		LDST(&thisCpu->c_intSaved[depth - 1]);
 	}
 	
+	/* Tempo speso dalle top half (compresi i livelli annidati) */
+	masked = (U32) (clockRead() - entry);
+	if(masked > intTopHalfMax) intTopHalfMax = masked;
+	
+	/* Le bottom half sono interrompibili da tutte le linee */
+	runDeferredWork();
+	
+	/* Tempo nel gestore, confrontabile con quello misurato a interrupt sempre mascherati */
+	masked = (U32) (clockRead() - entry);
+	if(masked > intHandlerMax) intHandlerMax = masked;
+	
+	thisCpu->c_intNew->reg_sp = intStackTop(0);
+	thisCpu->c_intDepth--;
+	maskedEnd();
+	
 	scheduler();
 }
@@ -0,0 +1,194 @@
+/**
+ *  @file ktimer.c
+ *  @author Vincenzo Ferrari - Barbara Iadarola
+ *  @note Questo modulo implementa i timer del nucleo: un numero qualsiasi di timer (singoli o
+ *	  periodici) multiplexati sull'unico Interval Timer tramite la timer wheel. Pseudo-clock,
+ *	  quanto (con una sola CPU), DELAY e campionamento del carico ne sono i clienti.
+ *	  Le funzioni vanno chiamate con kernelLock preso.
+ */
+
+/* Inclusioni phase2 */
+#include <clock.e>
+#include <ktimer.e>
+#include <twheel.e>
+
+/* Inclusioni uMPS */
+#include <libumps.e>
+
+/**
+  * @brief Istante per cui è programmato l'Interval Timer
+ */
+HIDDEN tod_t ktimerProgrammed;
+
+/**
+  * @brief Timer armati su un tick in cui scadevano già altri timer (grazie al loro slack)
+ */
+U32 ktimerCoalesced;
+
+/**
+  * @brief Interrupt dell'Interval Timer risparmiati: timer accorpati dallo slack scaduti insieme ad altri
+ */
+U32 ktimerIrqSaved;
+
+/**
+  * @brief Tick della ruota in corso di elaborazione in ktimerRun, con i timer scaduti in quel tick
+  *	   e quanti di essi vi erano stati accorpati dallo slack
+ */
+HIDDEN U32 runTick;
+HIDDEN int runFired;
+HIDDEN int runJoined;
+
+/**
+  * @brief Conclude il conteggio di un tick elaborato da ktimerRun: ogni timer accorpato dallo
+  *	   slack a un tick in cui è scaduto anche un altro timer ha risparmiato un interrupt.
+  * @return void.
+ */
+HIDDEN void ktimerTickDone()
+{
+	if(runFired > 1) ktimerIrqSaved += MIN(runJoined, runFired - 1);
+	
+	runFired = runJoined = 0;
+}
+
+/**
+  * @brief Chiamata dalla timer wheel per ogni timer scaduto: riarma i timer periodici (senza
+  *	   accumulare ritardo, a meno che una scadenza non sia stata mancata del tutto) e chiama
+  *	   la funzione del timer.
+  * @param t : timer della ruota scaduto.
+  * @return void.
+ */
+HIDDEN void ktimerExpire(tw_timer_t *t)
+{
+	ktimer_t *k = container_of(t, ktimer_t, k_tw);
+	
+	k->k_fired++;
+	
+	/* I timer di uno stesso tick scadono uno dopo l'altro */
+	if((runFired > 0) && (t->t_expires != runTick)) ktimerTickDone();
+	runTick = t->t_expires;
+	runFired++;
+	if(k->k_joined) runJoined++;
+	
+	if(k->k_period != 0)
+	{
+		k->k_when += k->k_period;
+		if(k->k_when <= kernelNow)
+			k->k_when = kernelNow + k->k_period;
+		twAdd(&k->k_tw, k->k_when);
+		k->k_joined = FALSE;
+	}
+	
+	k->k_func(k);
+}
+
+/**
+  * @brief Inizializza un timer (disarmato).
+  * @param k : timer da inizializzare.
+  * @param func : funzione da chiamare alla scadenza.
+  * @return void.
+ */
+void ktimerInit(ktimer_t *k, void (*func)(ktimer_t *k))
+{
+	k->k_tw.t_armed = FALSE;
+	k->k_when = 0;
+	k->k_period = 0;
+	k->k_func = func;
+	k->k_fired = 0;
+	k->k_joined = FALSE;
+}
+
+/**
+  * @brief Arma un timer singolo che può scadere fino a slack microsecondi dopo la scadenza
+  *	   indicata, così da essere accorpato ad altri timer (se era armato, la scadenza viene
+  *	   sostituita). Se la scadenza precede quella per cui è programmato l'Interval Timer,
+  *	   questo viene anticipato.
+  * @param k : timer da armare.
+  * @param when : scadenza (microsecondi).
+  * @param slack : ritardo ammesso (microsecondi).
+  * @return void.
+ */
+void ktimerArmSlack(ktimer_t *k, tod_t when, U32 slack)
+{
+	twCancel(&k->k_tw);
+	
+	k->k_when = when;
+	k->k_period = 0;
+	k->k_joined = twAddRange(&k->k_tw, when, when + slack);
+	if(k->k_joined) ktimerCoalesced++;
+	
+	if(when < ktimerProgrammed) ktimerProgram();
+}
+
+/**
+  * @brief Arma un timer singolo per una scadenza precisa (vedi ktimerArmSlack).
+  * @param k : timer da armare.
+  * @param when : scadenza (microsecondi).
+  * @return void.
+ */
+void ktimerArm(ktimer_t *k, tod_t when)
+{
+	ktimerArmSlack(k, when, 0);
+}
+
+/**
+  * @brief Arma un timer periodico.
+  * @param k : timer da armare.
+  * @param first : prima scadenza (microsecondi).
+  * @param period : periodo (microsecondi, maggiore di 0).
+  * @return void.
+ */
+void ktimerArmPeriodic(ktimer_t *k, tod_t first, U32 period)
+{
+	ktimerArm(k, first);
+	k->k_period = period;
+}
+
+/**
+  * @brief Disarma un timer, anche periodico. L'Interval Timer non viene riprogrammato: al più
+  *	   arriverà un interrupt senza timer scaduti.
+  * @param k : timer da disarmare.
+  * @return void.
+ */
+void ktimerCancel(ktimer_t *k)
+{
+	twCancel(&k->k_tw);
+	k->k_period = 0;
+}
+
+/**
+  * @brief Esegue i timer scaduti fino a kernelNow e riprogramma l'Interval Timer.
+  * @return Ritorna il numero di timer scaduti.
+ */
+int ktimerRun()
+{
+	int count;
+	
+	count = twAdvance(kernelNow, ktimerExpire);
+	ktimerTickDone();
+	ktimerProgram();
+	
+	return count;
+}
+
+/**
+  * @brief Calcola il tempo che manca alla prossima scadenza tra tutti i timer del nucleo.
+  * @return Ritorna i microsecondi prima della prossima scadenza, TIMER_INFINITE se nessun timer è armato.
+ */
+U32 ktimerNext()
+{
+	return twNextEvent(kernelNow);
+}
+
+/**
+  * @brief Carica l'Interval Timer per la prossima scadenza.
+  * @return void.
+ */
+void ktimerProgram()
+{
+	U32 next;
+	
+	next = MIN(ktimerNext(), KTIMER_MAX_WAIT);
+	
+	ktimerProgrammed = kernelNow + next;
+	clockSetTimer(next);
+}
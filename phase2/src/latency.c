@@ -0,0 +1,151 @@
+/**
+ *  @file latency.c
+ *  @author Vincenzo Ferrari - Barbara Iadarola
+ *  @note Questo modulo raccoglie gli istogrammi delle latenze dei device, per linea e per device:
+ *	  dall'ingresso nel gestore degli interrupt all'ACK e allo sblocco del processo in attesa,
+ *	  e dallo sblocco alla sua esecuzione. Le misure ci sono solo compilando con -DLAT_HIST.
+ */
+
+/* Inclusioni phase2 */
+#include <clock.e>
+#include <cpu.e>
+#include <latency.e>
+#include <lock.e>
+
+/* Inclusioni uMPS */
+#include <libumps.e>
+
+#ifdef LAT_HIST
+/**
+  * @brief Istogrammi per linea (linee 3-7)
+ */
+HIDDEN lat_hist_t latLine[DEV_USED_INTS][LAT_KINDS];
+
+/**
+  * @brief Istogrammi per device (per i terminali, le due metà insieme)
+ */
+HIDDEN lat_hist_t latDev[DEV_USED_INTS][DEV_PER_INT][LAT_KINDS];
+
+/**
+  * @brief Aggiunge una latenza a un istogramma.
+  * @param h : istogramma.
+  * @param us : latenza (microsecondi).
+  * @return void.
+ */
+HIDDEN void latAdd(lat_hist_t *h, U32 us)
+{
+	U32 v;
+	int b;
+	
+	for(v=us, b=0; (v != 0) && (b < LAT_BUCKETS - 1); b++) v >>= 1;
+	
+	/* Le top half annidate e le altre CPU aggiornano gli stessi istogrammi */
+	atomicAdd(&h->h_count[b], 1);
+	if(us > h->h_max) h->h_max = us;
+}
+
+/**
+  * @brief Registra una latenza di un device negli istogrammi del device e della sua linea.
+  * @param d : descrittore del device.
+  * @param kind : tipo di latenza (LAT_ACK, LAT_WAKE, LAT_RUN).
+  * @param us : latenza (microsecondi).
+  * @return void.
+ */
+HIDDEN void latRecord(device_t *d, int kind, U32 us)
+{
+	latAdd(&latLine[d->d_line - DEV_DIFF][kind], us);
+	latAdd(&latDev[d->d_line - DEV_DIFF][d->d_dev][kind], us);
+}
+
+/**
+  * @brief Azzera gli istogrammi.
+  * @return void.
+ */
+void latInit()
+{
+	int line, dev, kind, b;
+	
+	for(line=0; line<DEV_USED_INTS; line++)
+		for(kind=0; kind<LAT_KINDS; kind++)
+		{
+			for(dev=0; dev<DEV_PER_INT; dev++)
+			{
+				for(b=0; b<LAT_BUCKETS; b++) latDev[line][dev][kind].h_count[b] = 0;
+				latDev[line][dev][kind].h_max = 0;
+			}
+			for(b=0; b<LAT_BUCKETS; b++) latLine[line][kind].h_count[b] = 0;
+			latLine[line][kind].h_max = 0;
+		}
+}
+
+/**
+  * @brief (Top half) Il device è stato riconosciuto: registra il tempo dall'ingresso nel gestore
+  *	   degli interrupt, che viene ricordato per lo sblocco del processo in attesa.
+  * @param d : descrittore del device.
+  * @return void.
+ */
+void latAck(device_t *d)
+{
+	d->d_latEntry = thisCpu->c_latEntry;
+	latRecord(d, LAT_ACK, (U32) (clockRead() - d->d_latEntry));
+}
+
+/**
+  * @brief (Bottom half) Il processo in attesa sul device è stato reso pronto.
+  * @param d : descrittore del device.
+  * @param p : processo sbloccato.
+  * @return void.
+ */
+void latWake(device_t *d, pcb_t *p)
+{
+	tod_t now = clockRead();
+	
+	latRecord(d, LAT_WAKE, (U32) (now - d->d_latEntry));
+	p->p_latDev = d;
+	p->p_latWake = now;
+}
+
+/**
+  * @brief Il processo sta per essere eseguito: se era stato sbloccato da un device registra il
+  *	   tempo trascorso da pronto.
+  * @param p : processo.
+  * @return void.
+ */
+void latDispatch(pcb_t *p)
+{
+	if(p->p_latDev == NULL) return;
+	
+	latRecord(p->p_latDev, LAT_RUN, (U32) (clockRead() - p->p_latWake));
+	p->p_latDev = NULL;
+}
+#endif
+
+/**
+  * @brief (SYS29) Copia gli istogrammi delle latenze di un device o di un'intera linea.
+  * @param line : linea di interrupt (3-7).
+  * @param dev : numero del device, -1 per l'intera linea.
+  * @param hist : vettore di LAT_KINDS istogrammi (indicizzato da LAT_ACK, LAT_WAKE, LAT_RUN).
+  * @return Restituisce 0 in caso di successo, -1 se gli argomenti non sono validi o se il nucleo
+  *	    è compilato senza LAT_HIST.
+ */
+int getLatency(int line, int dev, lat_hist_t *hist)
+{
+#ifdef LAT_HIST
+	lat_hist_t *src;
+	int kind, b;
+	
+	if((line < INT_LOWEST) || (line > INT_TERMINAL) || (dev < -1) || (dev >= DEV_PER_INT) || (hist == NULL))
+		return -1;
+	
+	src = (dev < 0) ? latLine[line - DEV_DIFF] : latDev[line - DEV_DIFF][dev];
+	for(kind=0; kind<LAT_KINDS; kind++)
+	{
+		for(b=0; b<LAT_BUCKETS; b++) hist[kind].h_count[b] = src[kind].h_count[b];
+		hist[kind].h_max = src[kind].h_max;
+	}
+	
+	return 0;
+#else
+	return -1;
+#endif
+}
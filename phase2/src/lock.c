@@ -0,0 +1,129 @@
+/**
+ *  @file lock.c
+ *  @author Vincenzo Ferrari - Barbara Iadarola
+ *  @note Questo modulo implementa gli spinlock del nucleo multiprocessore.
+ *	  Con NCPU == 1 le operazioni sui lock sono vuote.
+ *
+ *	  Ogni struttura condivisa ha il proprio lock. L'ordine di acquisizione è:
+ *	  kernelLock, devSemLock, quotaLock, Ready Queue (per indice di CPU crescente),
+ *	  aslLock, pcbLock, code dei dischi, code dei terminali. Una CPU può prendere un lock
+ *	  solo se di rank maggiore di tutti quelli che già detiene: compilando con -DLOCK_DEBUG
+ *	  l'ordine viene verificato.
+ *	  I lock detenuti (c_locksHeld) sono della CPU, non del livello di annidamento degli
+ *	  interrupt: una top half annidata deve prendere solo lock di rank maggiore di tutti
+ *	  quelli che il livello interrotto può detenere. Per questo i terminali (linea 7, lasciata
+ *	  smascherata dalle top half dei dischi) vengono dopo i dischi, e le linee 0-2 non ne
+ *	  prendono nessuno.
+ */
+
+/* Inclusioni phase2 */
+#include <cpu.e>
+#include <lock.e>
+
+/* Inclusioni uMPS */
+#include <libumps.e>
+
+/**
+  * @brief Lock dell'albero dei processi, della tabella dei pcb utilizzati, dello pseudo-clock e dei mutex:
+  *	   preso dalle SYSCALL e dalle eccezioni (kernelLockAcquire) e rilasciato all'uscita (kernelExit)
+ */
+spinlock_t kernelLock;
+
+/**
+  * @brief Inizializza un lock (libero).
+  * @param l : lock da inizializzare.
+  * @param rank : posizione del lock nell'ordine di acquisizione (LOCK_RANK_*).
+  * @return void.
+ */
+void lockInit(spinlock_t *l, int rank)
+{
+	l->l_value = 0;
+	l->l_rank = rank;
+	l->l_acquired = l->l_contended = 0;
+}
+
+/**
+  * @brief Acquisisce un lock, attendendo attivamente che si liberi.
+  * @param l : lock da acquisire.
+  * @return void.
+ */
+void lockAcquire(spinlock_t *l)
+{
+#if NCPU > 1
+#ifdef LOCK_DEBUG
+	/* Violazione dell'ordine: la CPU detiene già un lock di rank uguale o maggiore */
+	if(thisCpu->c_locksHeld & ~((1 << l->l_rank) - 1)) PANIC();
+#endif
+	
+	if(!CAS(&l->l_value, 0, 1))
+	{
+		while(!CAS(&l->l_value, 0, 1)) ;
+		l->l_contended++;
+	}
+	l->l_acquired++;
+	
+#ifdef LOCK_DEBUG
+	thisCpu->c_locksHeld |= 1 << l->l_rank;
+#endif
+#endif
+}
+
+/**
+  * @brief Rilascia un lock.
+  * @param l : lock da rilasciare.
+  * @return void.
+ */
+void lockRelease(spinlock_t *l)
+{
+#if NCPU > 1
+#ifdef LOCK_DEBUG
+	thisCpu->c_locksHeld &= ~(1 << l->l_rank);
+#endif
+	
+	l->l_value = 0;
+#endif
+}
+
+/**
+  * @brief Acquisisce kernelLock, se la CPU non lo detiene già (es. SYS riservata in User Mode
+  *	   gestita come Program Trap). Viene rilasciato da kernelExit().
+  * @return void.
+ */
+void kernelLockAcquire()
+{
+	if(thisCpu->c_kernelLocked) return;
+	
+	lockAcquire(&kernelLock);
+	thisCpu->c_kernelLocked = TRUE;
+}
+
+/**
+  * @brief Rilascia kernelLock, se la CPU lo detiene.
+  * @return void.
+ */
+void kernelLockRelease()
+{
+	if(!thisCpu->c_kernelLocked) return;
+	
+	thisCpu->c_kernelLocked = FALSE;
+	lockRelease(&kernelLock);
+}
+
+/**
+  * @brief Somma atomicamente un valore a un contatore condiviso (aggiornato sotto lock diversi).
+  * @param v : contatore.
+  * @param delta : valore da sommare.
+  * @return void.
+ */
+void atomicAdd(U32 *v, int delta)
+{
+#if NCPU > 1
+	U32 old;
+	
+	do {
+		old = *v;
+	} while(!CAS(v, old, old + delta));
+#else
+	*v += delta;
+#endif
+}
@@ -83,6 +83,16 @@ typedef U32 pid_t;
 #define NOLEAVES		4	/* number of leaves of p8 process tree */
 #define MAXSEM			20
 
+#ifdef P2TEST_BENCH
+/* Benchmarks (build with -DP2TEST_BENCH): results are printed on Terminal0 */
+#define BENCHPROCS		8		/* CPU-bound processes of the SMP scaling benchmark */
+#define BENCHLOOP		200000	/* iterations of each of them */
+#define BENCHDISKPROCS	4		/* processes of the disk benchmark (fewer than BCACHE_BLOCKS) */
+#define BENCHDISKREQS	32		/* DISK_GETs of each of them */
+#define BENCHSECTORS	(BENCHDISKPROCS * BENCHDISKREQS)	/* sectors of disk 0: each is read once */
+#define BENCHSTRIDE		37		/* odd, so that it scatters all BENCHSECTORS sectors */
+#endif
+
 
 
 SEMAPHORE term_mut=1,	/* for mutual exclusion on terminal */
@@ -119,34 +129,66 @@ memaddr *p5MemLocation = 0;		/* To cause a p5 trap */
 void	p2(),p3(),p4(),p5(),p5a(),p5b(),p6(),p7(),p7a(),p5prog(),p5mm();
 void	p5sys(),p8root(),child1(),child2(),p8leaf();
 
+#ifdef P2TEST_BENCH
+SEMAPHORE endbench=0;	/* to signal the end of a benchmark process */
+
+state_t benchstate[BENCHPROCS];
+
+unsigned int benchbuf[BENCHDISKPROCS][PAGE_SIZE / WORD_SIZE];	/* DISK_GET buffers */
+
+void	benchsmp(),pbench(),benchdisk(),pbenchdisk();
+#endif
+
 
 /* a procedure to print on terminal 0 */
 void print(char *msg) {
 
 	char * s = msg;
-	devregtr * base = (devregtr *) (TERM0ADDR);
-	devregtr status;
+	int status;
 	
 	SYSCALL(PASSEREN, (int)&term_mut, 0, 0);				/* get term_mut lock */
 	
-	while (*s != '\0') {
-	  /* Put "transmit char" command+char in term0 register (3rd word). This 
-		   actually starts the operation on the device! */
-		*(base + 3) = PRINTCHR | (((devregtr) *s) << BYTELEN);
-		
-		/* Wait for I/O completion (SYS8) */
-		status = SYSCALL(WAITIO, INT_TERMINAL, 0, FALSE);
+	while (*s != '\0')
+		s++;
+	
+	/* The whole message in one call: the nucleus queues it and transmits
+	   it a character at a time (SYS14) */
+	status = SYSCALL(WRITETERMINAL, (int)msg, s - msg, 0);
+	
+	if (status != (s - msg))
+		PANIC();
+	
+	SYSCALL(VERHOGEN, (int)&term_mut, 0, 0);				/* release term_mut */
+}
 
-/*		PANIC(); */
-		
-		if ((status & TERMSTATMASK) != TRANSM)
-			PANIC();
 
-		s++;	
+#ifdef P2TEST_BENCH
+/* prints a message followed by a decimal number and a newline */
+void printnum(char *msg, unsigned int n) {
+
+	char buf[64];
+	char digits[10];
+	int i = 0, j = 0;
+	
+	while ((msg[i] != '\0') && (i < 50)) {
+		buf[i] = msg[i];
+		i++;
 	}
 	
-	SYSCALL(VERHOGEN, (int)&term_mut, 0, 0);				/* release term_mut */
+	do {
+		digits[j++] = '0' + (n % 10);
+		n /= 10;
+	} while (n > 0);
+	
+	while (j > 0)
+		buf[i++] = digits[--j];
+	
+	buf[i++] = '\n';
+	buf[i] = '\0';
+	
+	print(buf);
 }
+#endif
 
 
 /*                                                                   */
@@ -300,6 +342,11 @@ void test() {
 		SYSCALL(PASSEREN, (int)&endp8, 0, 0);
 	}
 
+#ifdef P2TEST_BENCH
+	benchsmp();
+	benchdisk();
+#endif
+
 	print("p1 finishes OK -- TTFN\n");
 	* ((memaddr *) BADADDR) = 0;				/* terminate p1 */
 
@@ -663,3 +710,123 @@ void p8leaf() {
 }
 
 
+#ifdef P2TEST_BENCH
+/* benchsmp -- SMP scaling benchmark: BENCHPROCS CPU-bound processes, */
+/* timed from the first creation to the last termination. Run it with */
+/* the kernel built with -DNCPU=1..8 (and as many CPUs in the machine */
+/* configuration): the elapsed time should shrink near-linearly       */
+void benchsmp() {
+	int		i;
+	cpu_t	start, end;
+
+	print("smp benchmark starts\n");
+
+	start = GET_TODLOW;
+
+	for (i = 0; i < BENCHPROCS; i++) {
+		STST(&benchstate[i]);
+		benchstate[i].reg_sp = gchild4state.reg_sp - ((i + 1) * QPAGE);
+		benchstate[i].pc_epc = benchstate[i].reg_t9 = (memaddr)pbench;
+		benchstate[i].status = benchstate[i].status | STATUS_IEp | STATUS_INT_UNMASKED;
+		
+		SYSCALL(CREATEPROCESS, (int)&benchstate[i], 0, 0);
+	}
+
+	for (i = 0; i < BENCHPROCS; i++)
+		SYSCALL(PASSEREN, (int)&endbench, 0, 0);
+
+	end = GET_TODLOW;
+
+	printnum("smp benchmark: NCPU ", NCPU);
+	printnum("smp benchmark: processes ", BENCHPROCS);
+	printnum("smp benchmark: elapsed us ", end - start);
+}
+
+/* pbench -- CPU-bound benchmark process */
+void pbench() {
+	volatile int	i;
+
+	for (i = 0; i < BENCHLOOP; i++)
+		;
+
+	SYSCALL(VERHOGEN, (int)&endbench, 0, 0);
+
+	SYSCALL(TERMINATEPROCESS, -1, 0, 0);
+}
+
+/* benchdisk -- disk seek benchmark: BENCHDISKPROCS processes issue  */
+/* BENCHDISKREQS DISK_GETs each, scattered over the first BENCHSECTORS */
+/* sectors of disk 0, so that requests pile up in the disk queue.     */
+/* Every sector is read exactly once and the cache is first filled    */
+/* with other sectors, so every read misses whatever the service      */
+/* order: the cache hits are printed with the timings to show it.     */
+/* Run it with the kernel built with and without -DDISK_FIFO: C-LOOK  */
+/* should need fewer seeks, a shorter seek distance and less busy     */
+/* time for the same requests                                         */
+void benchdisk() {
+	int				i;
+	cpu_t			start, end;
+	disk_stats_t	before, after;
+
+	/* no disk 0, or smaller than the benchmark needs */
+	if (SYSCALL(DISK_GET, (int)benchbuf[0], 0, BENCHSECTORS + BCACHE_BLOCKS - 1) < 0) {
+		print("disk benchmark skipped\n");
+		return;
+	}
+
+	/* evict any benchmark sector left in the cache by the tests */
+	for (i = 0; i < BCACHE_BLOCKS - 1; i++)
+		SYSCALL(DISK_GET, (int)benchbuf[0], 0, BENCHSECTORS + i);
+
+#ifdef DISK_FIFO
+	print("disk benchmark starts (FIFO)\n");
+#else
+	print("disk benchmark starts (C-LOOK)\n");
+#endif
+
+	SYSCALL(GETDISKSTATS, 0, (int)&before, 0);
+	start = GET_TODLOW;
+
+	for (i = 0; i < BENCHDISKPROCS; i++) {
+		STST(&benchstate[i]);
+		benchstate[i].reg_sp = gchild4state.reg_sp - ((i + 1) * QPAGE);
+		benchstate[i].pc_epc = benchstate[i].reg_t9 = (memaddr)pbenchdisk;
+		benchstate[i].reg_a0 = i;
+		benchstate[i].status = benchstate[i].status | STATUS_IEp | STATUS_INT_UNMASKED;
+		
+		SYSCALL(CREATEPROCESS, (int)&benchstate[i], 0, 0);
+	}
+
+	for (i = 0; i < BENCHDISKPROCS; i++)
+		SYSCALL(PASSEREN, (int)&endbench, 0, 0);
+
+	end = GET_TODLOW;
+	SYSCALL(GETDISKSTATS, 0, (int)&after, 0);
+
+	printnum("disk benchmark: requests ", after.requests - before.requests);
+	printnum("disk benchmark: transfers ", after.transfers - before.transfers);
+	printnum("disk benchmark: seeks ", after.seeks - before.seeks);
+	printnum("disk benchmark: seek_dist ", after.seek_dist - before.seek_dist);
+	printnum("disk benchmark: busy_time us ", after.busy_time - before.busy_time);
+	printnum("disk benchmark: elapsed us ", end - start);
+	printnum("disk benchmark: cache hits ", after.cache_hits - before.cache_hits);
+	printnum("disk benchmark: cache misses ", after.cache_misses - before.cache_misses);
+}
+
+/* pbenchdisk -- disk benchmark process: reads its share of a        */
+/* scattered permutation of the benchmark sectors                    */
+void pbenchdisk(int n) {
+	int				i;
+
+	for (i = 0; i < BENCHDISKREQS; i++) {
+		if (SYSCALL(DISK_GET, (int)benchbuf[n], 0, ((n * BENCHDISKREQS + i) * BENCHSTRIDE) % BENCHSECTORS) < 0) {
+			print("error in disk benchmark read\n");
+			PANIC();
+		}
+	}
+
+	SYSCALL(VERHOGEN, (int)&endbench, 0, 0);
+
+	SYSCALL(TERMINATEPROCESS, -1, 0, 0);
+}
+#endif
@@ -8,70 +8,896 @@
 #include <pcb.e>
 
 /* Inclusioni phase2 */
+#include <clock.e>
+#include <cpu.e>
 #include <exceptions.e>
 #include <initial.e>
 #include <interrupts.e>
+#include <ktimer.e>
+#include <latency.e>
+#include <lock.e>
 #include <scheduler.e>
 
 /* Inclusioni uMPS */
 #include <libumps.e>
 
+/**
+  * @brief Gruppi di quota di CPU
+ */
+HIDDEN quota_group_t quotaGroups[MAXQUOTAGROUPS];
+
+/**
+  * @brief Lock dei gruppi di quota (le funzioni HIDDEN sui gruppi lo assumono già preso)
+ */
+spinlock_t quotaLock;
+
+/**
+  * @brief Media mobile del numero di processi pronti o in esecuzione (virgola fissa, LOAD_SHIFT bit)
+ */
+U32 loadAvg;
+
+/**
+  * @brief Timer del campionamento del carico
+ */
+HIDDEN ktimer_t loadTimer;
+
+/**
+  * @brief Toglie un processo dalla competizione per la CPU finché il suo gruppo non viene ricaricato.
+  * @param p : pcb del processo da strozzare.
+  * @return void.
+ */
+HIDDEN void throttleProcess(pcb_t *p)
+{
+	insertProcQ(&p->p_group->q_throttledQ, p);
+	p->p_isOnDev = IS_THROTTLED;
+	
+	/* Come per l'I/O, il processo attende un evento del clock: non è un deadlock */
+	atomicAdd(&softBlockCount, 1);
+}
+
+/**
+  * @brief Accoda un processo nella Ready Queue della sua CPU in ordine di priorità effettiva
+  *	   (FIFO a parità).
+  * @param p : pcb da accodare.
+  * @return void.
+ */
+HIDDEN void enqueueReady(pcb_t *p)
+{
+	cpu_data_t *c = &cpuData[p->p_cpu];
+	struct list_head *pos;
+	
+	/* Si parte dal fondo: a parità di priorità l'inserimento è immediato */
+	list_for_each_prev(pos, &c->c_readyQueue)
+		if(container_of(pos, pcb_t, p_next)->p_effprio >= p->p_effprio) break;
+	
+	list_add(&p->p_next, pos);
+	c->c_readyCount++;
+}
+
+/**
+  * @brief Toglie un processo dalla Ready Queue della sua CPU.
+  * @param p : pcb da togliere.
+  * @return void.
+ */
+HIDDEN void dequeueReady(pcb_t *p)
+{
+	list_del(&p->p_next);
+	cpuData[p->p_cpu].c_readyCount--;
+}
+
+/**
+  * @brief Prende il lock della Ready Queue della CPU di un processo pronto. Il processo può essere
+  *	   spostato da un'altra CPU (stealWork) prima che il lock sia preso: in tal caso si riprova.
+  * @param p : pcb del processo.
+  * @return Ritorna la CPU il cui lock è stato preso.
+ */
+HIDDEN cpu_data_t *lockReadyOf(pcb_t *p)
+{
+	cpu_data_t *c;
+	
+	while(TRUE)
+	{
+		c = &cpuData[p->p_cpu];
+		lockAcquire(&c->c_readyLock);
+		if(c == &cpuData[p->p_cpu]) return c;
+		lockRelease(&c->c_readyLock);
+	}
+}
+
+/**
+  * @brief Sceglie la CPU su cui accodare un processo: quella su cui era (la cache è ancora calda)
+  *	   se la sua affinità lo permette, altrimenti la CPU permessa con la Ready Queue più corta.
+  * @param p : pcb del processo.
+  * @return Ritorna il numero della CPU scelta.
+ */
+HIDDEN int pickCpu(pcb_t *p)
+{
+	int i, best;
+	
+	if(p->p_affinity & CPU_MASK(p->p_cpu)) return p->p_cpu;
+	
+	best = p->p_cpu;
+	for(i=0; i<cpuCount; i++)
+		if((p->p_affinity & CPU_MASK(i)) &&
+		   ((best == p->p_cpu) || (cpuData[i].c_readyCount < cpuData[best].c_readyCount)))
+			best = i;
+	
+	return best;
+}
+
+/**
+  * @brief Sveglia una CPU inattiva permessa dall'affinità di un processo rimasto in coda su una
+  *	   CPU occupata, così che lo prenda (stealWork). Le CPU inattive non hanno alcun timer
+  *	   armato: senza l'interrupt inter-processore il processo attenderebbe la sua CPU.
+  * @param p : pcb del processo.
+  * @return void.
+ */
+HIDDEN void kickIdle(pcb_t *p)
+{
+	int i;
+	
+	/* La CPU corrente, se inattiva, passa comunque dallo scheduler */
+	if((thisCpu->c_current == NULL) && (p->p_affinity & CPU_MASK(CPU_ID))) return;
+	
+	for(i=0; i<cpuCount; i++)
+		if((i != p->p_cpu) && (p->p_affinity & CPU_MASK(i)) && (cpuData[i].c_current == NULL))
+		{
+			cpuKick(i);
+			return;
+		}
+}
+
+/**
+  * @brief Rende pronto un processo, accodandolo nella Ready Queue di una CPU permessa dalla sua
+  *	   affinità. Se quella CPU è un'altra e la deve rivedere subito (è inattiva, esegue un
+  *	   processo meno prioritario o, avendo la coda vuota, non ha il timer del quanto armato),
+  *	   le si invia un interrupt inter-processore; altrimenti si sveglia una CPU inattiva.
+  * @param p : pcb del processo.
+  * @return void.
+ */
+HIDDEN void makeReady(pcb_t *p)
+{
+	cpu_data_t *c;
+	pcb_t *running;
+	int first;
+	
+	p->p_isOnDev = FALSE;
+	p->p_readyTOD = kernelNow;
+	p->p_cpu = pickCpu(p);
+	c = &cpuData[p->p_cpu];
+	
+	lockAcquire(&c->c_readyLock);
+	enqueueReady(p);
+	first = (c->c_readyCount == 1);
+	lockRelease(&c->c_readyLock);
+	
+	/* Lettura senza lock: al più si invia un interrupt inutile */
+	running = c->c_current;
+	if((c != thisCpu) && ((running == NULL) || (running->p_effprio < p->p_effprio) || first))
+		cpuKick(p->p_cpu);
+	else
+		kickIdle(p);
+}
+
+/**
+  * @brief Strozza un gruppo che ha esaurito il budget, togliendo i suoi membri dalle Ready Queue.
+  * @param g : gruppo da strozzare.
+  * @return void.
+ */
+HIDDEN void throttleGroup(quota_group_t *g)
+{
+	struct list_head *queue, *pos, *next;
+	pcb_t *p;
+	int i;
+	
+	g->q_throttled = TRUE;
+	g->q_throttleCount++;
+	
+	for(i=0; i<cpuCount; i++)
+	{
+		queue = &cpuData[i].c_readyQueue;
+		
+		lockAcquire(&cpuData[i].c_readyLock);
+		for(pos = queue->next; pos != queue; pos = next)
+		{
+			next = pos->next;
+			p = container_of(pos, pcb_t, p_next);
+			
+			if(p->p_group == g)
+			{
+				dequeueReady(p);
+				p->p_wait_time += kernelNow - p->p_readyTOD;
+				throttleProcess(p);
+			}
+		}
+		lockRelease(&cpuData[i].c_readyLock);
+	}
+}
+
+/**
+  * @brief Sblocca un gruppo strozzato, reinserendo i suoi membri nella Ready Queue.
+  * @param g : gruppo da sbloccare.
+  * @return void.
+ */
+HIDDEN void releaseGroup(quota_group_t *g)
+{
+	pcb_t *p;
+	
+	g->q_throttled = FALSE;
+	
+	while((p = removeProcQ(&g->q_throttledQ)) != NULL)
+	{
+		atomicAdd(&softBlockCount, -1);
+		makeReady(p);
+	}
+}
+
+/**
+  * @brief Addebita tempo di CPU al gruppo di quota di un processo, strozzandolo se ha esaurito il budget.
+  * @param p : pcb del processo.
+  * @param delta : tempo di CPU da addebitare.
+  * @return void.
+ */
+HIDDEN void chargeGroup(pcb_t *p, cpu_t delta)
+{
+	quota_group_t *g = p->p_group;
+	
+	if(g == NULL) return;
+	
+	lockAcquire(&quotaLock);
+	
+	g->q_used += delta;
+	
+	if((g->q_used >= g->q_budget) && !g->q_throttled)
+		throttleGroup(g);
+	
+	lockRelease(&quotaLock);
+}
+
+/**
+  * @brief Inizializza la tabella dei gruppi di quota.
+  * @return void.
+ */
+void initQuotaGroups()
+{
+	int i;
+	
+	lockInit(&quotaLock, LOCK_RANK_QUOTA);
+	
+	for(i=0; i<MAXQUOTAGROUPS; i++)
+	{
+		quotaGroups[i].q_active = FALSE;
+		quotaGroups[i].q_members = 0;
+		quotaGroups[i].q_throttled = FALSE;
+		quotaGroups[i].q_throttleCount = 0;
+		mkEmptyProcQ(&quotaGroups[i].q_throttledQ);
+	}
+}
+
+/**
+  * @brief Toglie un processo dal suo gruppo di quota (anche dalla coda dei processi strozzati).
+  *	   Il gruppo viene liberato quando non ha più membri.
+  * @param p : pcb del processo.
+  * @return void.
+ */
+HIDDEN void leaveGroup(pcb_t *p)
+{
+	quota_group_t *g = p->p_group;
+	
+	if(g == NULL) return;
+	
+	if(p->p_isOnDev == IS_THROTTLED)
+	{
+		outProcQ(&g->q_throttledQ, p);
+		p->p_isOnDev = FALSE;
+		atomicAdd(&softBlockCount, -1);
+	}
+	
+	p->p_group = NULL;
+	
+	if(--g->q_members == 0)
+		g->q_active = FALSE;
+}
+
+/**
+  * @brief Come leaveGroup(), sotto quotaLock.
+  * @param p : pcb del processo.
+  * @return void.
+ */
+void quotaLeave(pcb_t *p)
+{
+	if(p->p_group == NULL) return;
+	
+	lockAcquire(&quotaLock);
+	leaveGroup(p);
+	lockRelease(&quotaLock);
+}
+
+/**
+  * @brief Inserisce un processo e tutta la sua progenie in un gruppo di quota.
+  * @param p : radice del sottoalbero.
+  * @param g : gruppo di quota.
+  * @return void.
+ */
+HIDDEN void quotaJoin(pcb_t *p, quota_group_t *g)
+{
+	pcb_t *child;
+	int wasThrottled;
+	
+	wasThrottled = (p->p_isOnDev == IS_THROTTLED);
+	
+	leaveGroup(p);
+	p->p_group = g;
+	g->q_members++;
+	
+	/* Un processo strozzato dal vecchio gruppo torna a competere secondo il nuovo */
+	if(wasThrottled)
+	{
+		if(g->q_throttled) throttleProcess(p);
+		else makeReady(p);
+	}
+	
+	list_for_each_entry(child, &p->p_child, p_sib)
+		quotaJoin(child, g);
+}
+
+/**
+  * @brief Crea un gruppo di quota per il sottoalbero di processi radicato in root.
+  *	   Con budget 0 il gruppo di root viene invece sciolto.
+  * @param root : radice del sottoalbero.
+  * @param budget : CPU concessa per periodo (in microsecondi).
+  * @param period : lunghezza del periodo (in microsecondi, almeno SCHED_PSEUDO_CLOCK).
+  * @return Ritorna l'indice del gruppo creato (0 se sciolto), -1 se non ci sono gruppi liberi.
+ */
+int quotaAssign(pcb_t *root, cpu_t budget, cpu_t period)
+{
+	quota_group_t *g;
+	int i;
+	
+	lockAcquire(&quotaLock);
+	
+	/* Scioglimento del gruppo di root: i membri tornano liberi */
+	if(budget == 0)
+	{
+		if((g = root->p_group) != NULL)
+		{
+			releaseGroup(g);
+			for(i=0; i<MAXPROC; i++)
+				if((pcbused_table[i].pcb != NULL) && (pcbused_table[i].pcb->p_group == g))
+					leaveGroup(pcbused_table[i].pcb);
+		}
+		lockRelease(&quotaLock);
+		return 0;
+	}
+	
+	for(i=0; i<MAXQUOTAGROUPS; i++)
+		if(!quotaGroups[i].q_active) break;
+	
+	if(i == MAXQUOTAGROUPS)
+	{
+		lockRelease(&quotaLock);
+		return -1;
+	}
+	
+	if(period < SCHED_PSEUDO_CLOCK) period = SCHED_PSEUDO_CLOCK;
+	if(budget > period) budget = period;
+	
+	g = &quotaGroups[i];
+	g->q_active = TRUE;
+	g->q_members = 0;
+	g->q_budget = budget;
+	g->q_period = period;
+	g->q_used = 0;
+	g->q_periodEnd = kernelNow + period;
+	g->q_throttled = FALSE;
+	g->q_throttleCount = 0;
+	mkEmptyProcQ(&g->q_throttledQ);
+	
+	quotaJoin(root, g);
+	
+	lockRelease(&quotaLock);
+	
+	return i;
+}
+
+/**
+  * @brief Ricarica i gruppi il cui periodo è terminato (chiamata a ogni pseudo-clock tick).
+  *	   L'eventuale sforamento del budget viene scalato dal periodo successivo.
+  * @return void.
+ */
+void quotaTick()
+{
+	quota_group_t *g;
+	int i;
+	
+	lockAcquire(&quotaLock);
+	
+	for(i=0; i<MAXQUOTAGROUPS; i++)
+	{
+		g = &quotaGroups[i];
+		
+		if(!g->q_active || (kernelNow < g->q_periodEnd)) continue;
+		
+		g->q_used = (g->q_used > g->q_budget) ? (g->q_used - g->q_budget) : 0;
+		
+		g->q_periodEnd += g->q_period;
+		if(g->q_periodEnd <= kernelNow)
+			g->q_periodEnd = kernelNow + g->q_period;
+		
+		if(g->q_throttled && (g->q_used < g->q_budget))
+			releaseGroup(g);
+	}
+	
+	lockRelease(&quotaLock);
+}
+
+/**
+  * @brief Campiona il numero di processi pronti o in esecuzione e aggiorna la media mobile
+  *	   esponenziale loadAvg (timer periodico del nucleo, ogni LOAD_PERIOD).
+  * @param k : timer del campionamento.
+  * @return void.
+ */
+HIDDEN void loadSample(ktimer_t *k)
+{
+	U32 n;
+	int i;
+	
+	n = cpuBusy();
+	for(i=0; i<cpuCount; i++)
+		n += cpuData[i].c_readyCount;
+	
+	loadAvg = ((loadAvg * LOAD_EXP) + (n * LOAD_FIXED_1 * (LOAD_FIXED_1 - LOAD_EXP))) >> LOAD_SHIFT;
+}
+
+/**
+  * @brief Avvia il campionamento del carico del sistema.
+  * @return void.
+ */
+void initLoadAvg()
+{
+	loadAvg = 0;
+	
+	ktimerInit(&loadTimer, loadSample);
+	ktimerArmPeriodic(&loadTimer, kernelNow + LOAD_PERIOD, LOAD_PERIOD);
+}
+
+/**
+  * @brief Adatta il quanto di un processo con quanto adattivo: cresce se il processo lo esaurisce
+  *	   (processo batch), si riduce se il processo si blocca prima di averne usato metà (interattivo).
+  * @param p : pcb del processo.
+  * @param exhausted : TRUE se il processo ha esaurito il quanto, FALSE se si è bloccato.
+  * @return void.
+ */
+HIDDEN void adaptQuantum(pcb_t *p, int exhausted)
+{
+	if(!p->p_adaptive) return;
+	
+	if(exhausted)
+		p->p_quantum = MIN(p->p_quantum + (p->p_quantum >> 1), SCHED_QUANTUM_MAX);
+	else if(p->p_slice_time < (p->p_quantum >> 1))
+	{
+		p->p_quantum -= p->p_quantum >> 2;
+		if(p->p_quantum < SCHED_QUANTUM_MIN) p->p_quantum = SCHED_QUANTUM_MIN;
+	}
+}
+
+/**
+  * @brief Contabilizza l'ingresso nel nucleo: il tempo trascorso dall'ultimo dispatch viene
+  *	   addebitato come tempo utente al processo interrotto, che diventa il processo per conto
+  *	   del quale il nucleo lavora fino alla successiva uscita.
+  * @return void.
+ */
+void kernelEntry()
+{
+	tod_t now;
+	cpu_t delta;
+	
+	/* Ingresso annidato (es. SYS riservata in User Mode gestita come Program Trap) */
+	if(kernelEntered) return;
+	
+	/* Unica lettura del TOD per questo ingresso: il resto del nucleo usa kernelNow */
+	now = clockSample();
+	
+	if(currentProcess != NULL)
+	{
+		delta = now - processTOD;
+		currentProcess->p_cpu_time += delta;
+		currentProcess->p_slice_time += delta;
+		chargeGroup(currentProcess, delta);
+	}
+	
+	kernelTOD = now;
+	kernelProcess = currentProcess;
+	kernelEntered = TRUE;
+}
+
+/**
+  * @brief Addebita il tempo di nucleo trascorso da kernelTOD come tempo di sistema al processo
+  *	   per conto del quale si è entrati, e fa ripartire kernelTOD da ora.
+  * @return void.
+ */
+HIDDEN void chargeKernel()
+{
+	cpu_t delta;
+	
+	clockSample();
+	
+	if(kernelEntered && (kernelProcess != NULL))
+	{
+		delta = kernelNow - kernelTOD;
+		kernelProcess->p_cpu_time += delta;
+		kernelProcess->p_sys_time += delta;
+		chargeGroup(kernelProcess, delta);
+		if(kernelProcess == currentProcess)
+			kernelProcess->p_slice_time += delta;
+	}
+	
+	kernelTOD = kernelNow;
+}
+
+/**
+  * @brief Contabilizza l'uscita dal nucleo: il tempo trascorso nel nucleo viene addebitato come
+  *	   tempo di sistema al processo per conto del quale si è entrati (anche se nel frattempo si è
+  *	   bloccato), e riparte il cronometro del processo che sta per essere eseguito.
+  *	   Rilascia kernelLock, se preso: deve precedere immediatamente LDST() o l'attesa.
+  * @return void.
+ */
+void kernelExit()
+{
+	int entered = kernelEntered;
+	
+	chargeKernel();
+	
+	/* Il processo ha lasciato la CPU bloccandosi su un semaforo */
+	if(entered && (kernelProcess != NULL) && (kernelProcess != currentProcess) &&
+	   (kernelProcess->p_isOnDev != FALSE) && (kernelProcess->p_isOnDev != IS_THROTTLED))
+	{
+		kernelProcess->p_blocks++;
+		adaptQuantum(kernelProcess, FALSE);
+	}
+	
+	kernelProcess = NULL;
+	kernelEntered = FALSE;
+	processTOD = kernelNow;
+	
+	cpuPublishLoad();
+	kernelLockRelease();
+}
+
+/**
+  * @brief Inserisce un processo nella Ready Queue, annotando l'istante d'inserimento.
+  *	   Se il gruppo di quota del processo è strozzato, il processo attende invece la ricarica.
+  * @param p : pcb del processo pronto.
+  * @return void.
+ */
+void insertReady(pcb_t *p)
+{
+	/* Solo i membri di un gruppo di quota richiedono quotaLock */
+	if(p->p_group == NULL)
+	{
+		makeReady(p);
+		return;
+	}
+	
+	lockAcquire(&quotaLock);
+	
+	if((p->p_group != NULL) && p->p_group->q_throttled)
+		throttleProcess(p);
+	else
+		makeReady(p);
+	
+	lockRelease(&quotaLock);
+}
+
+/**
+  * @brief Rimuove il primo processo dalla Ready Queue, aggiornando il suo tempo d'attesa, e ne fa
+  *	   il processo corrente della CPU. Entrambe le cose avvengono sotto il lock della coda, così
+  *	   che per le altre CPU un processo pronto sia sempre in coda o in esecuzione.
+  * @return Ritorna il pcb rimosso, NULL se la Ready Queue è vuota.
+ */
+pcb_t *removeReady()
+{
+	cpu_data_t *c = thisCpu;
+	pcb_t *p;
+	
+	lockAcquire(&c->c_readyLock);
+	
+	if((p = removeProcQ(&c->c_readyQueue)) != NULL)
+	{
+		c->c_readyCount--;
+		p->p_wait_time += kernelNow - p->p_readyTOD;
+	}
+	c->c_current = p;
+	
+	lockRelease(&c->c_readyLock);
+	
+	return p;
+}
+
+/**
+  * @brief Rimuove un processo specifico dalla Ready Queue della sua CPU.
+  * @param p : pcb da rimuovere.
+  * @return Ritorna il pcb rimosso, NULL se non era nella Ready Queue.
+ */
+pcb_t *outReady(pcb_t *p)
+{
+	cpu_data_t *c = lockReadyOf(p);
+	
+	if((p = outProcQ(&c->c_readyQueue, p)) != NULL)
+		c->c_readyCount--;
+	
+	lockRelease(&c->c_readyLock);
+	
+	return p;
+}
+
+/**
+  * @brief Se la Ready Queue della CPU corrente è vuota, vi sposta un processo preso dalla più
+  *	   lunga tra le code delle altre CPU. Viene preso l'ultimo processo della coda (il meno
+  *	   prioritario, che la CPU d'origine eseguirebbe per ultimo) la cui affinità permette
+  *	   la CPU corrente.
+  * @return Ritorna TRUE se è stato trovato un processo, FALSE altrimenti.
+ */
+HIDDEN int stealWork()
+{
+	cpu_data_t *victim;
+	struct list_head *pos;
+	pcb_t *p;
+	int self, i;
+	
+	self = CPU_ID;
+	victim = NULL;
+	
+	for(i=0; i<cpuCount; i++)
+		if((i != self) && (cpuData[i].c_readyCount > 0) &&
+		   ((victim == NULL) || (cpuData[i].c_readyCount > victim->c_readyCount)))
+			victim = &cpuData[i];
+	
+	if(victim == NULL) return FALSE;
+	
+	/* I lock delle due code vanno presi in ordine di CPU crescente */
+	if(victim < &cpuData[self])
+	{
+		lockAcquire(&victim->c_readyLock);
+		lockAcquire(&cpuData[self].c_readyLock);
+	}
+	else
+	{
+		lockAcquire(&cpuData[self].c_readyLock);
+		lockAcquire(&victim->c_readyLock);
+	}
+	
+	/* La coda può essersi svuotata prima che i lock fossero presi */
+	p = NULL;
+	list_for_each_prev(pos, &victim->c_readyQueue)
+		if(container_of(pos, pcb_t, p_next)->p_affinity & CPU_MASK(self))
+		{
+			p = container_of(pos, pcb_t, p_next);
+			break;
+		}
+	
+	if(p != NULL)
+	{
+		dequeueReady(p);
+		p->p_cpu = self;
+		enqueueReady(p);
+		
+		cpuData[self].c_steals++;
+	}
+	
+	lockRelease(&victim->c_readyLock);
+	lockRelease(&cpuData[self].c_readyLock);
+	
+	return (p != NULL);
+}
+
+/**
+  * @brief Imposta la priorità effettiva di un processo, riposizionandolo se è nella Ready Queue.
+  * @param p : pcb del processo.
+  * @param prio : nuova priorità effettiva.
+  * @return void.
+ */
+void setEffPriority(pcb_t *p, int prio)
+{
+	if(p->p_effprio == prio) return;
+	
+	p->p_effprio = prio;
+	
+	/* Se è in una Ready Queue (e non in esecuzione), viene riposizionato */
+	if(p->p_isOnDev == FALSE)
+	{
+		cpu_data_t *c = lockReadyOf(p);
+		
+		if(outProcQ(&c->c_readyQueue, p) != NULL)
+		{
+			c->c_readyCount--;
+			enqueueReady(p);
+		}
+		
+		lockRelease(&c->c_readyLock);
+	}
+}
+
+/**
+  * @brief Applica una nuova maschera di affinità a un processo. Se è pronto su una CPU non più
+  *	   permessa viene spostato; se è in esecuzione su un'altra CPU, questa viene svegliata così
+  *	   che lo migri (vedi scheduler). Il processo corrente migra all'uscita dalla SYSCALL.
+  * @param p : pcb del processo.
+  * @param mask : nuova maschera (non vuota, con sole CPU esistenti).
+  * @return void.
+ */
+void setAffinityMask(pcb_t *p, U32 mask)
+{
+	p->p_affinity = mask;
+	
+	if((mask & CPU_MASK(p->p_cpu)) || (p->p_isOnDev != FALSE) || (p == currentProcess)) return;
+	
+	if(outReady(p) != NULL)
+	{
+		p->p_wait_time += kernelNow - p->p_readyTOD;
+		insertReady(p);
+	}
+	else cpuKick(p->p_cpu);
+}
+
+/**
+  * @brief Libera il pcb del processo corrente se è stato terminato da un'altra CPU mentre era in
+  *	   esecuzione (terminateProcess non può liberare il pcb di un processo su un'altra CPU).
+  * @return Ritorna TRUE se il processo corrente è stato liberato, FALSE altrimenti.
+ */
+int reapKilled()
+{
+	pcb_t *p = currentProcess;
+	
+	if((p == NULL) || !p->p_killed) return FALSE;
+	
+	currentProcess = NULL;
+	if(kernelProcess == p) kernelProcess = NULL;
+	
+	freePcb(p);
+	
+	return TRUE;
+}
+
+/**
+  * @brief Prelaziona il processo corrente, reinserendolo nella Ready Queue.
+  * @param expired : TRUE se il processo ha esaurito il suo quanto, FALSE se cede il posto a un
+  *	   processo con priorità maggiore.
+  * @return void.
+ */
+void preemptCurrent(int expired)
+{
+	currentProcess->p_preemptions++;
+	if(expired) adaptQuantum(currentProcess, TRUE);
+	
+	insertReady(currentProcess);
+	currentProcess = NULL;
+}
+
+/**
+  * @brief Calcola il valore con cui caricare il timer del quanto per il processo corrente.
+  *	   In modalità tickless, se nessun altro processo è pronto, il quanto non viene considerato
+  *	   e il timer del quanto non viene armato (gli altri eventi sono timer del nucleo a sé).
+  *	   Con più CPU, un'altra CPU che riempie la coda invia un interrupt inter-processore
+  *	   (vedi makeReady).
+  * @param p : pcb del processo corrente.
+  * @return Ritorna il tempo (in microsecondi) prima del prossimo interrupt del timer.
+ */
+HIDDEN U32 nextTimerEvent(pcb_t *p)
+{
+	U32 next;
+	
+	/* Nessun altro processo è pronto: la scadenza del quanto non avrebbe effetto */
+	if(SCHED_TICKLESS && emptyProcQ(&readyQueue))
+		next = TIMER_INFINITE;
+	/* Quanto già esaurito (il processo ha proseguito in modalità tickless) */
+	else if(p->p_slice_time >= p->p_quantum)
+		return 1;
+	else
+		next = p->p_quantum - p->p_slice_time;
+	
+	/* Il processo non deve superare il budget residuo del suo gruppo di quota */
+	if(p->p_group != NULL)
+		next = MIN(next, (p->p_group->q_used < p->p_group->q_budget) ? (p->p_group->q_budget - p->p_group->q_used) : 1);
+	
+	return next;
+}
+
 /**
   * @brief Gestione dello scheduler.
   * @return void.
  */ 
 void scheduler()
 {
+	/* Il processo corrente è stato terminato da un'altra CPU */
+	reapKilled();
+	
 	/* Se esiste attualmente un processo in esecuzione */
 	if(currentProcess != NULL)
 	{		
-		/* Imposta il tempo di partenza del processo sulla CPU */
-		currentProcess->p_cpu_time += (GET_TODLOW - processTOD);
-		processTOD = GET_TODLOW;
+		/* Addebita il tempo di nucleo fin qui, così che il controllo del quanto ne tenga conto */
+		chargeKernel();
 		
-		/* Aggiorna il tempo trascorso dello pseudo-clock tick*/
-		timerTick += (GET_TODLOW - startTimerTick);
-		startTimerTick = GET_TODLOW;
-		
-		/* Imposta l'Interval Timer col tempo minore rimanente tra il timeslice e lo pseudo-clock tick */
-		SET_IT(MIN((SCHED_TIME_SLICE - currentProcess->p_cpu_time), (SCHED_PSEUDO_CLOCK - timerTick)));
+		/* Se il gruppo di quota del processo ha esaurito il budget, il processo attende la ricarica */
+		if((currentProcess->p_group != NULL) && currentProcess->p_group->q_throttled)
+		{
+			insertReady(currentProcess);
+			currentProcess = NULL;
+		}
+		/* Se il processo ha proseguito oltre il quanto perché era l'unico pronto (tickless),
+		   ma nel frattempo un altro processo è diventato pronto, cede il processore */
+		else if((currentProcess->p_slice_time >= currentProcess->p_quantum) && !emptyProcQ(&readyQueue))
+			preemptCurrent(TRUE);
+		/* Se è diventato pronto un processo con priorità maggiore, cede il processore */
+		else if(!emptyProcQ(&readyQueue) && (headProcQ(&readyQueue)->p_effprio > currentProcess->p_effprio))
+			preemptCurrent(FALSE);
+		/* Se la sua affinità non permette più questa CPU, migra su un'altra */
+		else if(!(currentProcess->p_affinity & CPU_MASK(CPU_ID)))
+			preemptCurrent(FALSE);
+		else
+		{
+			/* Carica il timer col tempo rimanente del quanto (o del budget del gruppo di quota),
+			   prima che kernelExit rilasci kernelLock: con una sola CPU è un timer del nucleo.
+			   Il tempo fino a LDST è addebitato al processo, quindi il quanto resta esatto */
+			clockSetSliceTimer(nextTimerEvent(currentProcess));
+			
+			/* Chiude la contabilità del nucleo e riavvia il cronometro del processo */
+			kernelExit();
 
-		/* Carica lo stato del processo corrente */
-		LDST(&(currentProcess->p_state));
+			/* Carica lo stato del processo corrente */
+			LDST(&(currentProcess->p_state));
+		}
 	}
+	
 	/* Se invece non è presente nessun processo sulla CPU */
-	else if(currentProcess == NULL)
+	if(currentProcess == NULL)
 	{
-		/* Se la Ready Queue è vuota */
-		if(emptyProcQ(&readyQueue))
+		/* Se la Ready Queue è vuota e non c'è lavoro da prendere alle altre CPU */
+		if(emptyProcQ(&readyQueue) && !stealWork())
 		{
 			if(processCount == 0) HALT();
-			if((processCount > 0) && (softBlockCount == 0)) PANIC();	/* Deadlock */
-			if((processCount > 0) && (softBlockCount > 0))
-			{
-				/* Wait State */
-				/* Interrupt attivati e non mascherati */
-				setSTATUS((getSTATUS() | STATUS_IEc | STATUS_INT_UNMASKED));
-				while(TRUE) ;
-			}
-			PANIC(); /* caso anomalo */
+			
+			/* Deadlock: nessun processo è pronto, in esecuzione su un'altra CPU o in attesa di I/O */
+			if((softBlockCount == 0) && (cpuBusy() == 0)) PANIC();
+			
+			thisCpu->c_idle++;
+			
+			/* Non c'è alcun quanto da far scadere: chi rende pronto un processo che questa
+			   CPU può eseguire la sveglia con un interrupt inter-processore */
+			clockSetSliceTimer(TIMER_INFINITE);
+			
+			/* Il tempo d'attesa non è addebitato ad alcun processo */
+			kernelExit();
+			
+			/* Wait State */
+			/* Interrupt attivati e non mascherati */
+			setSTATUS((getSTATUS() | STATUS_IEc | STATUS_INT_UNMASKED));
+			while(TRUE) ;
 		}
 		
 		/* Prende il primo processo Ready */
-		currentProcess = removeProcQ(&readyQueue);
+		if(removeReady() == NULL)
+		{
+			/* La coda è stata svuotata da un'altra CPU nel frattempo */
+			if(NCPU > 1) scheduler();
+			PANIC(); /* caso anomalo */
+		}
 		
-		if(currentProcess == NULL) PANIC(); /* caso anomalo */
+		/* Processo terminato da un'altra CPU mentre era pronto o in transito */
+		if(reapKilled()) scheduler();
 		
-		/* Calcola i millisecondi trascorsi dall'avvio dello pseudo-clock tick */
-		timerTick += GET_TODLOW - startTimerTick;
-		startTimerTick = GET_TODLOW;
+		/* Inizia un nuovo quanto */
+		currentProcess->p_slice_time = 0;
+		currentProcess->p_dispatches++;
+		thisCpu->c_dispatches++;
+		latDispatch(currentProcess);
 		
-		/* Imposta il tempo di partenza del processo sulla CPU */
-		currentProcess->p_cpu_time = 0;
-		processTOD = GET_TODLOW;
+		/* Carica il timer col tempo rimanente del quanto (o del budget del gruppo di quota),
+		   prima che kernelExit rilasci kernelLock; il quanto perde le poche istruzioni fino a LDST */
+		clockSetSliceTimer(nextTimerEvent(currentProcess));
 		
-		/* Imposta l'Interval Timer col tempo minore rimanente tra il timeslice e lo pseudo-clock tick */
-		SET_IT(MIN(SCHED_TIME_SLICE, (SCHED_PSEUDO_CLOCK - timerTick)));
+		/* Riavvia il cronometro del processo sulla CPU */
+		kernelExit();
 		
 		/* Carica lo stato del processo sul processore */
 		LDST(&(currentProcess->p_state));
@@ -0,0 +1,806 @@
+/**
+ *  @file terminal.c
+ *  @author Vincenzo Ferrari - Barbara Iadarola
+ *  @note Questo modulo implementa la SYS14 (WRITETERMINAL): lo scrittore di turno copia il suo
+ *	  buffer, nella propria SYSCALL, in una coda di trasmissione del terminale che la top
+ *	  half svuota un carattere alla volta dando subito il comando successivo. Quanto non ci
+ *	  sta viene copiato ripetendo la SYSCALL quando la coda è scesa a TERM_TX_LOW caratteri;
+ *	  lo scrittore ritorna quando i suoi caratteri sono stati trasmessi.
+ *	  La SYS13 (READTERMINAL) legge dalla coda di ricezione, riempita dalla top half con la
+ *	  disciplina di linea (eco e cancellazione): il lettore è svegliato a riga completa, o
+ *	  quando la riga in corso riempie il suo buffer, e la copia ripetendo la SYSCALL.
+ *	  In entrambi i versi la memoria di un processo è toccata solo nella sua SYSCALL.
+ *	  Un comando dato direttamente al trasmettitore (WAITIO) non viene sovrascritto: la coda
+ *	  riparte al suo completamento.
+ */
+
+/* Inclusioni phase1 */
+#include <pcb.e>
+
+/* Inclusioni phase2 */
+#include <cpu.e>
+#include <initial.e>
+#include <interrupts.e>
+#include <latency.e>
+#include <lock.e>
+#include <scheduler.e>
+#include <terminal.e>
+
+/* Inclusioni uMPS */
+#include <libumps.e>
+
+/**
+  * @brief Code di trasmissione, per terminale
+ */
+HIDDEN term_t terms[DEV_PER_INT];
+
+/**
+  * @brief Prende il lock di un terminale a interrupt mascherati: la top half dello stesso
+  *	   terminale non può interrompere chi lo detiene.
+  * @param t : terminale.
+  * @return Ritorna lo Status da ripristinare con termUnlock.
+ */
+HIDDEN U32 termLock(term_t *t)
+{
+	U32 s = getSTATUS();
+	
+	setSTATUS(s & ~STATUS_IEc);
+	lockAcquire(&t->t_lock);
+	
+	return s;
+}
+
+/**
+  * @brief Rilascia il lock di un terminale e ripristina lo Status.
+  * @param t : terminale.
+  * @param s : Status ritornato da termLock.
+  * @return void.
+ */
+HIDDEN void termUnlock(term_t *t, U32 s)
+{
+	lockRelease(&t->t_lock);
+	setSTATUS(s);
+}
+
+/**
+  * @brief Dà al trasmettitore il comando per il primo carattere della coda (riconoscendo anche
+  *	   l'interrupt pendente).
+  * @param t : terminale.
+  * @param reg : registro del terminale.
+  * @return void.
+ */
+HIDDEN void termTxSend(term_t *t, termreg_t *reg)
+{
+	reg->transm_command = (((U32) (U8) t->t_txBuf[t->t_txHead & TERM_TX_MASK]) << TERM_CHAR_SHIFT) | DEV_TTRS_C_TRSMCHAR;
+}
+
+/**
+  * @brief Avvia il trasmettitore, se fermo e se la coda non è vuota. Se il trasmettitore ha un
+  *	   comando dato direttamente (WAITIO) in corso o non ancora riconosciuto, la coda
+  *	   ripartirà da termTxResume. Va chiamata con il lock del terminale.
+  * @param t : terminale.
+  * @param reg : registro del terminale.
+  * @return void.
+ */
+HIDDEN void termTxStart(term_t *t, termreg_t *reg)
+{
+	if(!t->t_txBusy && (t->t_txCount > 0) && ((reg->transm_status & CHECK_STATUS_BIT) == DEV_S_READY))
+	{
+		t->t_txBusy = TRUE;
+		termTxSend(t, reg);
+	}
+}
+
+/**
+  * @brief Accoda un carattere da trasmettere, con lo scrittore che l'ha copiato. Va chiamata con
+  *	   il lock del terminale e con spazio nella coda.
+  * @param t : terminale.
+  * @param c : carattere.
+  * @param p : scrittore (NULL per l'eco).
+  * @return void.
+ */
+HIDDEN void termTxPut(term_t *t, char c, pcb_t *p)
+{
+	U32 i = (t->t_txHead + t->t_txCount) & TERM_TX_MASK;
+	
+	t->t_txBuf[i] = c;
+	t->t_txOwner[i] = p;
+	t->t_txCount++;
+}
+
+/**
+  * @brief Accoda un carattere da trasmettere per l'eco, avviando il trasmettitore se fermo. A coda
+  *	   piena l'eco viene perso. Va chiamata con il lock del terminale.
+  * @param t : terminale.
+  * @param reg : registro del terminale.
+  * @param c : carattere.
+  * @return void.
+ */
+HIDDEN void termEcho(term_t *t, termreg_t *reg, char c)
+{
+	if(t->t_txCount == TERM_TX_SIZE) return;
+	
+	termTxPut(t, c, NULL);
+	termTxStart(t, reg);
+}
+
+/**
+  * @brief Scarta dalla coda i caratteri di uno scrittore, compattando gli altri. Va chiamata con
+  *	   il lock del terminale.
+  * @param t : terminale.
+  * @param p : scrittore.
+  * @param first : numero di caratteri in testa da lasciare dove sono (1 per quello in trasmissione).
+  * @return void.
+ */
+HIDDEN void termTxDrop(term_t *t, pcb_t *p, U32 first)
+{
+	U32 i, n, from, to;
+	
+	for(i = n = first; i < t->t_txCount; i++)
+	{
+		from = (t->t_txHead + i) & TERM_TX_MASK;
+		if(t->t_txOwner[from] == p) continue;
+		
+		to = (t->t_txHead + n) & TERM_TX_MASK;
+		t->t_txBuf[to] = t->t_txBuf[from];
+		t->t_txOwner[to] = t->t_txOwner[from];
+		n++;
+	}
+	
+	p->p_ioQueued -= t->t_txCount - n;
+	t->t_txCount = n;
+}
+
+/**
+  * @brief Valore di ritorno di una WRITETERMINAL conclusa.
+  * @param p : scrittore.
+  * @return Ritorna i caratteri accettati, o il negato dello status se la trasmissione è fallita.
+ */
+HIDDEN int termTxResult(pcb_t *p)
+{
+	int ret;
+	
+	ret = (p->p_ioError != 0) ? -(int) (p->p_ioError & CHECK_STATUS_BIT) : (int) p->p_ioDone;
+	p->p_ioError = 0;
+	
+	return ret;
+}
+
+/**
+  * @brief Prepara uno scrittore a ripetere la sua WRITETERMINAL sul resto del buffer, o un
+  *	   lettore a ripetere la sua READTERMINAL.
+  * @param p : processo, con p_ioBuf e p_ioLeft sul (resto del) buffer.
+  * @return void.
+ */
+HIDDEN void termRestart(pcb_t *p)
+{
+	p->p_state.pc_epc -= WORD_SIZE;
+	p->p_state.reg_a1 = (U32) p->p_ioBuf;
+	p->p_state.reg_a2 = p->p_ioLeft;
+}
+
+/**
+  * @brief Passa nella lista done gli scrittori da svegliare: chi non ha più caratteri nella coda
+  *	   (con il valore di ritorno), lo scrittore di turno se la coda è scesa a TERM_TX_LOW
+  *	   caratteri (o se la sua trasmissione è fallita) e, se il turno è libero, il primo
+  *	   scrittore in attesa. Chi deve copiare ripete la SYSCALL. Va chiamata con il lock
+  *	   del terminale.
+  * @param t : terminale.
+  * @param done : lista che riceve gli scrittori da svegliare.
+  * @return void.
+ */
+HIDDEN void termTxAdvance(term_t *t, struct list_head *done)
+{
+	struct list_head *pos;
+	pcb_t *p;
+	
+	t->t_txDone = FALSE;
+	
+	pos = t->t_draining.next;
+	while(pos != &t->t_draining)
+	{
+		p = container_of(pos, pcb_t, p_next);
+		pos = pos->next;
+		
+		if(p->p_ioQueued > 0) continue;
+		
+		outProcQ(&t->t_draining, p);
+		p->p_state.reg_v0 = termTxResult(p);
+		insertProcQ(done, p);
+	}
+	
+	p = t->t_txTurn;
+	if((p != NULL) && t->t_txWait)
+	{
+		/* Una trasmissione fallita conclude la richiesta, e il turno passa */
+		if(p->p_ioError != 0)
+		{
+			p->p_state.reg_v0 = termTxResult(p);
+			t->t_txTurn = NULL;
+			t->t_txWait = FALSE;
+			insertProcQ(done, p);
+		}
+		else if(t->t_txCount <= TERM_TX_LOW)
+		{
+			termRestart(p);
+			t->t_txWait = FALSE;
+			insertProcQ(done, p);
+		}
+	}
+	
+	if((t->t_txTurn == NULL) && (t->t_txCount <= TERM_TX_LOW) && ((p = removeProcQ(&t->t_writers)) != NULL))
+	{
+		t->t_txTurn = p;
+		termRestart(p);
+		insertProcQ(done, p);
+	}
+}
+
+/**
+  * @brief Rende pronti gli scrittori da svegliare. Va chiamata senza il lock del terminale.
+  * @param d : descrittore della metà in trasmissione del terminale.
+  * @param done : scrittori da svegliare.
+  * @return void.
+ */
+HIDDEN void termWake(device_t *d, struct list_head *done)
+{
+	pcb_t *p;
+	
+	while((p = removeProcQ(done)) != NULL)
+	{
+		latWake(d, p);
+		atomicAdd(&softBlockCount, -1);
+		insertReady(p);
+	}
+}
+
+/**
+  * @brief (Bottom half) Sveglia gli scrittori conclusi e quello che può copiare il resto.
+  * @param d : descrittore della metà in trasmissione del terminale.
+  * @param status : non usato.
+  * @return void.
+ */
+HIDDEN void termTxWork(device_t *d, U32 status)
+{
+	term_t *t = &terms[d->d_dev];
+	struct list_head done;
+	U32 s;
+	
+	/* Serializzata con terminateProcess, che può togliere uno scrittore (rilasciato da kernelExit) */
+	kernelLockAcquire();
+	
+	mkEmptyProcQ(&done);
+	
+	s = termLock(t);
+	t->t_txWork = FALSE;
+	t->t_txWakeups++;
+	termTxAdvance(t, &done);
+	termUnlock(t, s);
+	
+	termWake(d, &done);
+}
+
+/**
+  * @brief (Top half) Trasmissione completata su un terminale: se il carattere viene dalla coda
+  *	   di trasmissione, dà subito il comando per il successivo (o l'ACK se la coda è vuota).
+  *	   Se la trasmissione è fallita, scarta gli altri caratteri dello stesso scrittore (un
+  *	   eco fallito non tocca nessuno). Accoda la bottom half quando uno scrittore non ha più
+  *	   caratteri nella coda, o quando questa è scesa a TERM_TX_LOW caratteri e uno scrittore
+  *	   attende spazio o il turno.
+  * @param d : descrittore della metà in trasmissione del terminale.
+  * @return Ritorna TRUE se l'interrupt è stato servito, FALSE se la trasmissione non veniva dalla coda (WAITIO).
+ */
+int termTxIntr(device_t *d)
+{
+	term_t *t = &terms[d->d_dev];
+	termreg_t *reg = &d->d_reg->term;
+	pcb_t *p;
+	U32 status;
+	
+	/* La top half interrompe solo codice che non detiene il lock (interrupt mascherati) */
+	lockAcquire(&t->t_lock);
+	
+	if(!t->t_txBusy)
+	{
+		lockRelease(&t->t_lock);
+		return FALSE;
+	}
+	
+	status = reg->transm_status;
+	p = t->t_txOwner[t->t_txHead & TERM_TX_MASK];
+	t->t_txHead++;
+	t->t_txCount--;
+	
+	if((status & CHECK_STATUS_BIT) == DEV_TTRS_S_CHARTRSM) t->t_txChars++;
+	
+	if(p != NULL)
+	{
+		p->p_ioQueued--;
+		
+		if((status & CHECK_STATUS_BIT) != DEV_TTRS_S_CHARTRSM)
+		{
+			p->p_ioError = status;
+			termTxDrop(t, p, 0);
+		}
+		
+		if(p->p_ioQueued == 0) t->t_txDone = TRUE;
+	}
+	
+	if(t->t_txCount > 0) termTxSend(t, reg);
+	else
+	{
+		reg->transm_command = DEV_C_ACK;
+		t->t_txBusy = FALSE;
+	}
+	
+	if(!t->t_txWork && (t->t_txDone || ((t->t_txCount <= TERM_TX_LOW) && (t->t_txWait || ((t->t_txTurn == NULL) && !emptyProcQ(&t->t_writers))))))
+	{
+		t->t_txWork = TRUE;
+		queueWork(termTxWork, d, 0);
+	}
+	
+	lockRelease(&t->t_lock);
+	
+	return TRUE;
+}
+
+/**
+  * @brief (Top half) Trasmissione di un comando dato direttamente (WAITIO) completata: la riconosce,
+  *	   facendo ripartire la coda se nel frattempo vi sono stati accodati caratteri.
+  * @param d : descrittore della metà in trasmissione del terminale.
+  * @return void.
+ */
+void termTxResume(device_t *d)
+{
+	term_t *t = &terms[d->d_dev];
+	termreg_t *reg = &d->d_reg->term;
+	
+	/* Sotto il lock: chi accoda vede il trasmettitore libero solo dopo l'ACK */
+	lockAcquire(&t->t_lock);
+	
+	if(t->t_txCount > 0)
+	{
+		t->t_txBusy = TRUE;
+		termTxSend(t, reg);
+	}
+	else reg->transm_command = DEV_C_ACK;
+	
+	lockRelease(&t->t_lock);
+}
+
+/**
+  * @brief (SYS14) Scrive un buffer su un terminale. Solo lo scrittore di turno copia nella coda,
+  *	   quanto ci sta; se resta altro si blocca e, quando la coda è scesa a TERM_TX_LOW
+  *	   caratteri, ripete la SYSCALL sul resto del buffer. Chi trova il turno occupato si
+  *	   blocca e la ripete quando lo ottiene. Copiato tutto, cede il turno e attende la
+  *	   trasmissione dei suoi caratteri (o il suo fallimento).
+  * @param buf : caratteri da scrivere.
+  * @param len : numero di caratteri.
+  * @param term : numero del terminale.
+  * @return Ritorna len, il negato dello status se la trasmissione è fallita, -1 se i parametri non sono validi o il terminale non è installato.
+ */
+int writeTerminal(char *buf, int len, int term)
+{
+	device_t *d;
+	term_t *t;
+	pcb_t *p = currentProcess;
+	struct list_head done;
+	U32 s;
+	int n;
+	
+	if((term < 0) || (term >= DEV_PER_INT) || (len < 0) || ((buf == NULL) && (len > 0))) return -1;
+	
+	d = &devTable[DEV_ROW(INT_TERMINAL, FALSE)][term];
+	if(d->d_reg == NULL) return -1;
+	if(len == 0) return 0;
+	
+	t = &terms[term];
+	
+	/* Gli interrupt del terminale arrivano alla CPU su cui lo scrittore si blocca */
+	irtRouteHere(INT_TERMINAL, term);
+	
+	p->p_ioDev = term;
+	
+	mkEmptyProcQ(&done);
+	
+	s = termLock(t);
+	
+	/* Nuova richiesta, e nessuno scrittore la precede */
+	if((t->t_txTurn == NULL) && emptyProcQ(&t->t_writers))
+	{
+		t->t_txTurn = p;
+		p->p_ioDone = 0;
+	}
+	
+	if(t->t_txTurn != p)
+	{
+		p->p_ioBuf = buf;
+		p->p_ioLeft = len;
+		p->p_ioDone = 0;
+		insertProcQ(&t->t_writers, p);
+	}
+	/* Ripresa dopo una trasmissione fallita: la richiesta è conclusa */
+	else if(p->p_ioError != 0)
+	{
+		t->t_txTurn = NULL;
+		termTxAdvance(t, &done);
+		termUnlock(t, s);
+		
+		termWake(d, &done);
+		return termTxResult(p);
+	}
+	else
+	{
+		for(n = 0; (n < len) && (t->t_txCount < TERM_TX_SIZE); n++)
+			termTxPut(t, buf[n], p);
+		
+		p->p_ioQueued += n;
+		p->p_ioDone += n;
+		termTxStart(t, &d->d_reg->term);
+		
+		/* Il resto verrà copiato ripetendo la SYSCALL */
+		if(n < len)
+		{
+			p->p_ioBuf = buf + n;
+			p->p_ioLeft = len - n;
+			t->t_txWait = TRUE;
+		}
+		else
+		{
+			t->t_txTurn = NULL;
+			insertProcQ(&t->t_draining, p);
+			termTxAdvance(t, &done);
+		}
+	}
+	
+	p->p_isOnDev = IS_ON_TERM;
+	currentProcess = NULL;
+	atomicAdd(&softBlockCount, 1);
+	termUnlock(t, s);
+	
+	/* Il turno è passato al prossimo scrittore */
+	termWake(d, &done);
+	
+	scheduler();
+	
+	return 0;
+}
+/**
+  * @brief Disciplina di linea: aggiunge un carattere ricevuto alla riga in corso, con l'eco.
+  *	   La cancellazione toglie l'ultimo carattere della riga in corso, CR e LF (salvati
+  *	   come LF) la concludono; a coda piena la riga in corso viene considerata conclusa e i
+  *	   caratteri successivi sono scartati. Va chiamata con il lock del terminale.
+  * @param t : terminale.
+  * @param reg : registro del terminale.
+  * @param c : carattere ricevuto.
+  * @return void.
+ */
+HIDDEN void termRxChar(term_t *t, termreg_t *reg, char c)
+{
+	if((c == TERM_ERASE) || (c == TERM_DEL))
+	{
+		if(t->t_rxPartial == 0) return;
+		
+		t->t_rxCount--;
+		t->t_rxPartial--;
+		termEcho(t, reg, TERM_ERASE);
+		termEcho(t, reg, ' ');
+		termEcho(t, reg, TERM_ERASE);
+		return;
+	}
+	
+	if(t->t_rxCount == TERM_RX_SIZE)
+	{
+		t->t_rxLost++;
+		return;
+	}
+	
+	if(c == '\r') c = '\n';
+	
+	t->t_rxBuf[(t->t_rxHead + t->t_rxCount) & TERM_RX_MASK] = c;
+	t->t_rxCount++;
+	t->t_rxPartial++;
+	t->t_rxChars++;
+	termEcho(t, reg, c);
+	
+	if((c == '\n') || (t->t_rxCount == TERM_RX_SIZE)) t->t_rxPartial = 0;
+}
+
+/**
+  * @brief Una lettura di len caratteri può concludersi: c'è una riga conclusa, o la riga in corso
+  *	   ne ha già almeno len. Va chiamata con il lock del terminale.
+  * @param t : terminale.
+  * @param len : dimensione del buffer del lettore.
+  * @return Ritorna TRUE se la lettura può concludersi, FALSE altrimenti.
+ */
+HIDDEN int termRxReady(term_t *t, U32 len)
+{
+	return (t->t_rxCount > t->t_rxPartial) || (t->t_rxPartial >= len);
+}
+
+/**
+  * @brief Copia una riga conclusa (fino al LF compreso) dalla coda di ricezione, al più len
+  *	   caratteri: il resto della riga resta per la lettura successiva. Senza righe concluse
+  *	   copia i primi len caratteri della riga in corso, se ne ha almeno tanti (questi non
+  *	   possono più essere cancellati). Va chiamata con il lock del terminale.
+  * @param t : terminale.
+  * @param buf : buffer del lettore.
+  * @param len : dimensione del buffer.
+  * @return Ritorna il numero di caratteri copiati (0 se la lettura non può concludersi).
+ */
+HIDDEN int termRxCopy(term_t *t, char *buf, U32 len)
+{
+	U32 n = 0;
+	char c = 0;
+	
+	if(!termRxReady(t, len)) return 0;
+	
+	while((n < len) && (t->t_rxCount > 0) && (c != '\n'))
+	{
+		if(t->t_rxCount == t->t_rxPartial) t->t_rxPartial--;
+		
+		c = t->t_rxBuf[t->t_rxHead & TERM_RX_MASK];
+		t->t_rxHead++;
+		t->t_rxCount--;
+		buf[n++] = c;
+	}
+	
+	return n;
+}
+
+/**
+  * @brief Serve i lettori in attesa, in ordine: se il primo può leggere diventa il lettore di
+  *	   turno e ripeterà la SYSCALL, che copia la riga; chi è colpito da una ricezione fallita
+  *	   ritorna subito. Gli uni e gli altri passano nella lista done. Non fa nulla finché il
+  *	   lettore di turno non ha letto. Va chiamata con il lock del terminale.
+  * @param t : terminale.
+  * @param done : lista che riceve i lettori da svegliare.
+  * @return void.
+ */
+HIDDEN void termRxServe(term_t *t, struct list_head *done)
+{
+	pcb_t *p;
+	
+	while((t->t_rxTurn == NULL) && ((p = headProcQ(&t->t_readers)) != NULL))
+	{
+		if(t->t_rxError != 0)
+		{
+			p->p_state.reg_v0 = -(int) (t->t_rxError & CHECK_STATUS_BIT);
+			t->t_rxError = 0;
+		}
+		else if(termRxReady(t, p->p_ioLeft))
+		{
+			t->t_rxTurn = p;
+			termRestart(p);
+		}
+		else return;
+		
+		removeProcQ(&t->t_readers);
+		insertProcQ(done, p);
+	}
+}
+
+/**
+  * @brief (Bottom half) Sveglia il lettore che può leggere (o quelli colpiti da una ricezione fallita).
+  * @param d : descrittore della metà in ricezione del terminale.
+  * @param status : non usato.
+  * @return void.
+ */
+HIDDEN void termRxWork(device_t *d, U32 status)
+{
+	term_t *t = &terms[d->d_dev];
+	struct list_head done;
+	U32 s;
+	
+	/* Serializzata con terminateProcess, che può togliere un lettore (rilasciato da kernelExit) */
+	kernelLockAcquire();
+	
+	mkEmptyProcQ(&done);
+	
+	s = termLock(t);
+	t->t_rxWork = FALSE;
+	termRxServe(t, &done);
+	termUnlock(t, s);
+	
+	termWake(d, &done);
+}
+
+/**
+  * @brief (Top half) Ricezione completata su un terminale pilotato dal nucleo: passa il carattere
+  *	   alla disciplina di linea, chiede subito il successivo e, se il primo lettore in attesa
+  *	   può essere servito, accoda la bottom half che lo sveglia.
+  * @param d : descrittore della metà in ricezione del terminale.
+  * @return Ritorna TRUE se l'interrupt è stato servito, FALSE se il ricevitore non è pilotato dal nucleo (WAITIO).
+ */
+int termRxIntr(device_t *d)
+{
+	term_t *t = &terms[d->d_dev];
+	termreg_t *reg = &d->d_reg->term;
+	pcb_t *p;
+	U32 status;
+	
+	lockAcquire(&t->t_lock);
+	
+	if(!t->t_rxActive)
+	{
+		lockRelease(&t->t_lock);
+		return FALSE;
+	}
+	
+	status = reg->recv_status;
+	if((status & CHECK_STATUS_BIT) == DEV_TRCV_S_CHARRECV)
+		termRxChar(t, reg, (char) ((status >> TERM_CHAR_SHIFT) & CHECK_STATUS_BIT));
+	else if(!emptyProcQ(&t->t_readers))
+		t->t_rxError = status;
+	
+	/* Il nuovo comando riconosce anche l'interrupt */
+	reg->recv_command = DEV_TRCV_C_RECVCHAR;
+	
+	p = headProcQ(&t->t_readers);
+	if(!t->t_rxWork && (t->t_rxTurn == NULL) && (p != NULL) && (termRxReady(t, p->p_ioLeft) || (t->t_rxError != 0)))
+	{
+		t->t_rxWork = TRUE;
+		queueWork(termRxWork, d, 0);
+	}
+	
+	lockRelease(&t->t_lock);
+	
+	return TRUE;
+}
+
+/**
+  * @brief (SYS13) Legge una riga da un terminale. Alla prima lettura il ricevitore passa al
+  *	   nucleo, che da allora riceve anche in anticipo sulle letture. Il processo si blocca
+  *	   se non c'è una riga conclusa né una riga in corso di almeno len caratteri (o se altri
+  *	   lettori lo precedono): svegliato, ripete la SYSCALL come lettore di turno e la copia.
+  * @param buf : buffer che riceve la riga (LF compreso, senza terminatore).
+  * @param len : dimensione del buffer.
+  * @param term : numero del terminale.
+  * @return Ritorna il numero di caratteri letti, il negato dello status se la ricezione è fallita, -1 se i parametri non sono validi o il terminale non è installato.
+ */
+int readTerminal(char *buf, int len, int term)
+{
+	device_t *d;
+	term_t *t;
+	pcb_t *p = currentProcess;
+	struct list_head done;
+	U32 s;
+	int n, turn;
+	
+	if((term < 0) || (term >= DEV_PER_INT) || (len < 0) || ((buf == NULL) && (len > 0))) return -1;
+	
+	d = &devTable[DEV_ROW(INT_TERMINAL, TRUE)][term];
+	if(d->d_reg == NULL) return -1;
+	if(len == 0) return 0;
+	
+	t = &terms[term];
+	
+	irtRouteHere(INT_TERMINAL, term);
+	
+	s = termLock(t);
+	
+	if(!t->t_rxActive)
+	{
+		t->t_rxActive = TRUE;
+		d->d_reg->term.recv_command = DEV_TRCV_C_RECVCHAR;
+	}
+	
+	/* Il lettore di turno legge per primo; gli altri solo se nessuno li precede */
+	turn = (t->t_rxTurn == p);
+	if(turn) t->t_rxTurn = NULL;
+	
+	if((turn || ((t->t_rxTurn == NULL) && emptyProcQ(&t->t_readers))) && termRxReady(t, len))
+	{
+		n = termRxCopy(t, buf, len);
+		
+		/* Se resta da leggere, tocca al prossimo lettore */
+		mkEmptyProcQ(&done);
+		termRxServe(t, &done);
+		termUnlock(t, s);
+		
+		termWake(d, &done);
+		return n;
+	}
+	
+	p->p_ioBuf = buf;
+	p->p_ioLeft = len;
+	p->p_ioDev = term;
+	
+	/* Il lettore di turno (la riga può essere stata accorciata da una cancellazione) resta il primo */
+	if(turn) list_add(&p->p_next, &t->t_readers);
+	else insertProcQ(&t->t_readers, p);
+	
+	p->p_isOnDev = IS_ON_TERM;
+	currentProcess = NULL;
+	atomicAdd(&softBlockCount, 1);
+	termUnlock(t, s);
+	
+	scheduler();
+	
+	return 0;
+}
+
+/**
+  * @brief Toglie un lettore o uno scrittore terminato dalla sua coda, e dalla coda di trasmissione
+  *	   i caratteri dello scrittore non ancora trasmessi (quello in trasmissione resta, senza
+  *	   scrittore). Se il processo aveva il turno, questo passa al successivo. Va chiamata
+  *	   anche per un processo pronto, che può avere il turno per ripetere una WRITETERMINAL
+  *	   o una READTERMINAL.
+  * @param p : processo da togliere.
+  * @return void.
+ */
+void termCancel(pcb_t *p)
+{
+	device_t *d;
+	term_t *t;
+	struct list_head done, rxDone;
+	U32 s;
+	
+	if(p->p_ioDev < 0) return;
+	
+	d = &devTable[DEV_ROW(INT_TERMINAL, FALSE)][p->p_ioDev];
+	t = &terms[p->p_ioDev];
+	
+	mkEmptyProcQ(&done);
+	mkEmptyProcQ(&rxDone);
+	
+	s = termLock(t);
+	
+	/* Il lettore di turno non leggerà più: tocca al successivo */
+	if(t->t_rxTurn == p)
+	{
+		t->t_rxTurn = NULL;
+		termRxServe(t, &rxDone);
+	}
+	
+	if(outProcQ(&t->t_readers, p) == NULL)
+	{
+		outProcQ(&t->t_writers, p);
+		outProcQ(&t->t_draining, p);
+		
+		if(t->t_txTurn == p)
+		{
+			t->t_txTurn = NULL;
+			t->t_txWait = FALSE;
+		}
+		
+		if(t->t_txBusy && (t->t_txOwner[t->t_txHead & TERM_TX_MASK] == p))
+			t->t_txOwner[t->t_txHead & TERM_TX_MASK] = NULL;
+		termTxDrop(t, p, t->t_txBusy ? 1 : 0);
+		p->p_ioQueued = 0;
+		p->p_ioError = 0;
+		
+		termTxAdvance(t, &done);
+	}
+	termUnlock(t, s);
+	
+	termWake(d, &done);
+	termWake(&devTable[DEV_ROW(INT_TERMINAL, TRUE)][p->p_ioDev], &rxDone);
+}
+
+/**
+  * @brief Inizializza le code di trasmissione e di ricezione dei terminali.
+  * @return void.
+ */
+void termInit()
+{
+	int i;
+	
+	for(i=0; i<DEV_PER_INT; i++)
+	{
+		lockInit(&terms[i].t_lock, LOCK_RANK_TERM);
+		terms[i].t_txHead = terms[i].t_txCount = 0;
+		terms[i].t_txBusy = terms[i].t_txWork = FALSE;
+		terms[i].t_txTurn = NULL;
+		terms[i].t_txWait = terms[i].t_txDone = FALSE;
+		mkEmptyProcQ(&terms[i].t_writers);
+		mkEmptyProcQ(&terms[i].t_draining);
+		terms[i].t_txChars = terms[i].t_txWakeups = 0;
+		terms[i].t_rxHead = terms[i].t_rxCount = terms[i].t_rxPartial = 0;
+		terms[i].t_rxActive = terms[i].t_rxWork = FALSE;
+		terms[i].t_rxError = 0;
+		mkEmptyProcQ(&terms[i].t_readers);
+		terms[i].t_rxTurn = NULL;
+		terms[i].t_rxChars = terms[i].t_rxLost = 0;
+	}
+}
@@ -0,0 +1,342 @@
+/**
+ *  @file twheel.c
+ *  @author Vincenzo Ferrari - Barbara Iadarola
+ *  @note Questo modulo implementa la timer wheel gerarchica delle scadenze (DELAY).
+ *	  Inserimento e cancellazione costano O(1); l'avanzamento salta gli slot vuoti
+ *	  grazie alle bitmap degli slot occupati, così che un lungo periodo d'inattività
+ *	  non costi un passo per ogni tick.
+ */
+
+/* Inclusioni phase2 */
+#include <twheel.e>
+
+#include <bitops.h>
+
+/* Indice dello slot di livello level in cui cade il tick t */
+#define TW_INDEX(t, level) (((t) >> ((level) * TW_SLOT_BITS)) & TW_SLOT_MASK)
+
+/**
+  * @brief Slot della ruota, per livello
+ */
+HIDDEN struct list_head twSlots[TW_LEVELS][TW_SLOTS];
+
+/**
+  * @brief Bitmap degli slot non vuoti, per livello
+ */
+HIDDEN U32 twMap[TW_LEVELS][TW_MAP_WORDS];
+
+/**
+  * @brief Ultimo tick elaborato da twAdvance
+ */
+HIDDEN U32 twClock;
+
+/**
+  * @brief Numero di timer nella ruota
+ */
+int twCount;
+
+/**
+  * @brief Cerca il primo slot non vuoto di un livello a partire da un indice.
+  * @param level : livello della ruota.
+  * @param from : primo indice da considerare.
+  * @return Ritorna l'indice trovato, -1 se gli slot da from in poi sono vuoti.
+ */
+HIDDEN int twNextSlot(int level, int from)
+{
+	U32 bits;
+	int w;
+	
+	if(from >= TW_SLOTS) return -1;
+	
+	w = from >> 5;
+	bits = twMap[level][w] & (0xFFFFFFFF << (from & 31));
+	
+	while(bits == 0)
+	{
+		if(++w >= TW_MAP_WORDS) return -1;
+		bits = twMap[level][w];
+	}
+	
+	return (w << 5) + ctz32(bits);
+}
+
+/**
+  * @brief Inserisce un timer nello slot adatto alla distanza della sua scadenza da twClock:
+  *	   il livello più basso che la contiene. Le scadenze oltre la ruota vanno nell'ultimo
+  *	   livello e vengono ricollocate quando lo slot scende.
+  * @param t : timer da inserire (t_expires non precede twClock).
+  * @return void.
+ */
+HIDDEN void twPlace(tw_timer_t *t)
+{
+	U32 delta, when;
+	int level, slot;
+	
+	delta = t->t_expires - twClock;
+	when = t->t_expires;
+	if(delta > TW_MAX_TICKS)
+	{
+		delta = TW_MAX_TICKS;
+		when = twClock + TW_MAX_TICKS;
+	}
+	
+	for(level=0; (level < TW_LEVELS - 1) && (delta >= (1U << ((level + 1) * TW_SLOT_BITS))); level++) ;
+	
+	slot = TW_INDEX(when, level);
+	list_add_tail(&t->t_next, &twSlots[level][slot]);
+	twMap[level][slot >> 5] |= 1U << (slot & 31);
+	t->t_slot = (level * TW_SLOTS) + slot;
+}
+
+/**
+  * @brief Toglie tutti i timer da uno slot, spostandoli in una lista.
+  * @param level : livello della ruota.
+  * @param slot : indice dello slot.
+  * @param list : lista (vuota) che riceve i timer.
+  * @return void.
+ */
+HIDDEN void twTake(int level, int slot, struct list_head *list)
+{
+	struct list_head *head = &twSlots[level][slot];
+	
+	if(list_empty(head)) return;
+	
+	list->next = head->next;
+	list->prev = head->prev;
+	list->next->prev = list;
+	list->prev->next = list;
+	INIT_LIST_HEAD(head);
+	
+	twMap[level][slot >> 5] &= ~(1U << (slot & 31));
+}
+
+/**
+  * @brief Fa scendere i timer di uno slot di livello superiore nei livelli più bassi.
+  * @param level : livello dello slot (>= 1).
+  * @param slot : indice dello slot.
+  * @return void.
+ */
+HIDDEN void twCascade(int level, int slot)
+{
+	struct list_head moved;
+	tw_timer_t *t;
+	
+	INIT_LIST_HEAD(&moved);
+	twTake(level, slot, &moved);
+	
+	while(!list_empty(&moved))
+	{
+		t = container_of(moved.next, tw_timer_t, t_next);
+		list_del(&t->t_next);
+		twPlace(t);
+	}
+}
+
+/**
+  * @brief Inizializza la ruota.
+  * @param now : istante corrente (microsecondi).
+  * @return void.
+ */
+void twInit(tod_t now)
+{
+	int level, slot;
+	
+	for(level=0; level<TW_LEVELS; level++)
+	{
+		for(slot=0; slot<TW_SLOTS; slot++)
+			INIT_LIST_HEAD(&twSlots[level][slot]);
+		for(slot=0; slot<TW_MAP_WORDS; slot++)
+			twMap[level][slot] = 0;
+	}
+	
+	twClock = (U32) (now >> TW_SHIFT);
+	twCount = 0;
+}
+
+/**
+  * @brief Cerca, tra i tick first e last (entro un giro del livello 0), il primo il cui slot di
+  *	   livello 0 contiene già dei timer.
+  * @param first : primo tick della finestra (successivo a twClock).
+  * @param last : ultimo tick della finestra.
+  * @param tick : riceve il tick trovato.
+  * @return Ritorna TRUE se è stato trovato uno slot occupato, FALSE altrimenti.
+ */
+HIDDEN int twBusyTick(U32 first, U32 last, U32 *tick)
+{
+	int from, slot;
+	
+	from = TW_INDEX(first, 0);
+	
+	/* La finestra può passare dalla fine all'inizio del livello */
+	if((slot = twNextSlot(0, from)) < 0)
+	{
+		if((slot = twNextSlot(0, 0)) < 0) return FALSE;
+		slot += TW_SLOTS;
+	}
+	if((U32) (slot - from) > (last - first)) return FALSE;
+	
+	*tick = first + (slot - from);
+	return TRUE;
+}
+
+/**
+  * @brief Arma un timer la cui scadenza può cadere ovunque in una finestra [when, latest]: per
+  *	   accorpare i risvegli, il timer va nel primo slot della finestra già occupato da altri
+  *	   timer, altrimenti sul tick più "rotondo" (multiplo della maggiore potenza di 2) della
+  *	   finestra, dove è più probabile che cadano anche i timer armati in seguito.
+  *	   La scadenza è arrotondata per eccesso al tick della ruota, così che il timer non scada
+  *	   mai in anticipo.
+  * @param t : timer da armare (non già armato).
+  * @param when : scadenza (microsecondi).
+  * @param latest : ultima scadenza accettabile (microsecondi, non precede when).
+  * @return Ritorna TRUE se il timer è stato accorpato a timer già presenti, FALSE altrimenti.
+ */
+int twAddRange(tw_timer_t *t, tod_t when, tod_t latest)
+{
+	U32 first, last, span;
+	int joined = FALSE;
+	
+	first = (U32) ((when + (1 << TW_SHIFT) - 1) >> TW_SHIFT);
+	last = (U32) (latest >> TW_SHIFT);
+	
+	/* Il tick twClock è già stato elaborato */
+	if((S32) (first - twClock) <= 0)
+		first = twClock + 1;
+	
+	t->t_expires = first;
+	
+	if((S32) (last - first) > 0)
+	{
+		if(((last - twClock) < TW_SLOTS) && twBusyTick(first, last, &t->t_expires))
+			joined = TRUE;
+		else
+		{
+			for(span=1; (span << 1) <= (last - first + 1); span <<= 1) ;
+			t->t_expires = last & ~(span - 1);
+		}
+	}
+	
+	twPlace(t);
+	t->t_armed = TRUE;
+	twCount++;
+	
+	return joined;
+}
+
+/**
+  * @brief Arma un timer per una scadenza precisa (vedi twAddRange).
+  * @param t : timer da armare (non già armato).
+  * @param when : scadenza (microsecondi).
+  * @return void.
+ */
+void twAdd(tw_timer_t *t, tod_t when)
+{
+	twAddRange(t, when, when);
+}
+
+/**
+  * @brief Disarma un timer, se armato.
+  * @param t : timer da disarmare.
+  * @return void.
+ */
+void twCancel(tw_timer_t *t)
+{
+	int level, slot;
+	
+	if(!t->t_armed) return;
+	
+	level = t->t_slot / TW_SLOTS;
+	slot = t->t_slot & TW_SLOT_MASK;
+	
+	list_del(&t->t_next);
+	if(list_empty(&twSlots[level][slot]))
+		twMap[level][slot >> 5] &= ~(1U << (slot & 31));
+	
+	t->t_armed = FALSE;
+	twCount--;
+}
+
+/**
+  * @brief Fa avanzare la ruota fino all'istante indicato, chiamando expire per ogni timer scaduto.
+  *	   I tick senza timer di livello 0 e senza slot da far scendere vengono saltati.
+  * @param now : istante corrente (microsecondi).
+  * @param expire : funzione chiamata per ogni timer scaduto (già disarmato).
+  * @return Ritorna il numero di timer scaduti.
+ */
+int twAdvance(tod_t now, void (*expire)(tw_timer_t *t))
+{
+	struct list_head fired;
+	tw_timer_t *t;
+	U32 target, tick, next;
+	int level, slot, count;
+	
+	target = (U32) (now >> TW_SHIFT);
+	count = 0;
+	
+	while((S32) (target - twClock) > 0)
+	{
+		tick = ++twClock;
+		
+		/* All'inizio di un giro del livello n-1 scende lo slot corrente del livello n */
+		for(level=1; (level < TW_LEVELS) && (TW_INDEX(tick, level - 1) == 0); level++) ;
+		while(--level >= 1)
+			twCascade(level, TW_INDEX(tick, level));
+		
+		/* Scadono i timer dello slot corrente di livello 0 */
+		INIT_LIST_HEAD(&fired);
+		twTake(0, TW_INDEX(tick, 0), &fired);
+		
+		while(!list_empty(&fired))
+		{
+			t = container_of(fired.next, tw_timer_t, t_next);
+			list_del(&t->t_next);
+			t->t_armed = FALSE;
+			twCount--;
+			count++;
+			expire(t);
+		}
+		
+		/* Salta fino al prossimo slot occupato di livello 0 o alla fine del giro */
+		slot = twNextSlot(0, TW_INDEX(tick, 0) + 1);
+		next = (slot < 0) ? (tick | TW_SLOT_MASK) : ((tick & ~TW_SLOT_MASK) + slot - 1);
+		if((S32) (next - target) > 0) next = target;
+		if((S32) (next - twClock) > 0) twClock = next;
+	}
+	
+	return count;
+}
+
+/**
+  * @brief Calcola il tempo prima del prossimo evento della ruota: la scadenza del primo timer di
+  *	   livello 0 o la discesa del primo slot occupato di un livello superiore (limite inferiore
+  *	   delle scadenze che contiene).
+  * @param now : istante corrente (microsecondi).
+  * @return Ritorna i microsecondi prima del prossimo evento, TIMER_INFINITE se la ruota è vuota.
+ */
+U32 twNextEvent(tod_t now)
+{
+	U32 best, cand, nowTick;
+	int level, cur, slot, dist;
+	
+	if(twCount == 0) return TIMER_INFINITE;
+	
+	best = twClock + TW_MAX_TICKS + 1;
+	
+	for(level=0; level<TW_LEVELS; level++)
+	{
+		cur = TW_INDEX(twClock, level);
+		
+		/* Gli slot che precedono quello corrente appartengono al giro successivo */
+		if((slot = twNextSlot(level, cur + 1)) >= 0) dist = slot - cur;
+		else if((slot = twNextSlot(level, 0)) >= 0) dist = slot - cur + TW_SLOTS;
+		else continue;
+		
+		cand = ((twClock >> (level * TW_SLOT_BITS)) + dist) << (level * TW_SLOT_BITS);
+		if((S32) (cand - best) < 0) best = cand;
+	}
+	
+	nowTick = (U32) (now >> TW_SHIFT);
+	if((S32) (best - nowTick) <= 0) return 1;
+	
+	return ((best - nowTick) << TW_SHIFT) - ((U32) now & ((1 << TW_SHIFT) - 1));
+}